@@ -0,0 +1,376 @@
+/*
+    main.c
+    Resident UART bootloader for AMBER Board
+
+    Lives in the top 2 KB of flash together with the hardware vector table.
+    Every hardware vector except RESET jumps through the application's proxy
+    vector table (see vectors.s43), so applications linked with
+    ../lnk430F2274_app.xcl run unchanged.
+
+    After a reset the bootloader starts the application right away unless the
+    serial cable is plugged in (PCCOMM high) or there is no application. With
+    the cable in, it waits BOOT_WAIT_TICKS for a SYNC frame from the PC before
+    giving up and starting the application. namasteTrunk resets into the
+    bootloader with the 'B' command, so firmware can be replaced on a docked
+    board without a JTAG / Spy-Bi-Wire programmer.
+*/
+
+#include <msp430.h>
+#include <stdbool.h>
+
+/* pin definitions */
+#define DBG0    BIT0    /* P1.0 - debug pin 0 */
+#define PCCOMM  BIT2    /* P2.2 - high indicates that the serial communications cable is plugged in */
+#define UARTRX  BIT4    /* P3.4 - UART RX Pin */
+#define UARTTX  BIT5    /* P3.5 - UART TX Pin */
+
+/* memory map
+ *
+ * 0x8000 - 0xF7DF  application
+ * 0xF7E0 - 0xF7FF  application interrupt vectors (proxy vector table)
+ * 0xF800 - 0xFFDF  bootloader
+ * 0xFFE0 - 0xFFFF  hardware interrupt vectors
+ */
+#define APP_START           0x8000
+#define APP_END             0xF800      /* first address after the application area */
+#define APP_RESET_VECTOR    (*(const unsigned short *)0xF7FE)
+#define SEGMENT_SIZE        512
+#define BLOCK_SIZE          64          /* flash row, the unit of a block write */
+#define ERASED_WORD         0xFFFF
+
+/* frames (both directions): SOF, type, length, payload, CRC-16-CCITT over
+ * type, length and payload (low-order byte first). Replies carry the type of
+ * the request and a status byte in front of their payload. */
+#define FRAME_SOF           0x7E
+#define FRAME_MAX_PAYLOAD   (2 + BLOCK_SIZE)
+#define CRC16_INIT          0xFFFF
+#define CRC16_POLY          0x1021
+
+/* commands */
+#define BOOT_SYNC       'S'     /* reply: version, block size, application area start and end */
+#define BOOT_BAUD       'B'     /* payload: baud code; reply at the old rate, then switch */
+#define BOOT_ERASE      'E'     /* payload: segment address */
+#define BOOT_WRITE      'W'     /* payload: address, up to BLOCK_SIZE bytes within one flash row */
+#define BOOT_CRC        'C'     /* payload: address, length; reply: CRC-16 of the range */
+#define BOOT_GO         'G'     /* start the application */
+#define BOOT_BAD_FRAME  '?'     /* reply type for a frame that failed its CRC */
+
+/* status values */
+#define BOOT_OK             0
+#define BOOT_ERR_FRAME      1   /* bad CRC or length */
+#define BOOT_ERR_ADDRESS    2   /* outside the application area or crosses a flash row */
+#define BOOT_ERR_VERIFY     3   /* flash does not read back as written */
+#define BOOT_ERR_COMMAND    4   /* unknown command or payload size */
+#define BOOT_ERR_NO_APP     5   /* no application to start */
+
+#define BOOT_VERSION        1
+
+/* baud codes */
+#define BAUD_9600           0   /* DCO 1 MHz */
+#define BAUD_115200         1   /* DCO 8 MHz */
+
+/* timing constants */
+#define BOOT_WAIT_TICKS     1365    /* 1 sec, assuming 1365 Hz clock (ACLK/8) */
+#define FTG_DIV_1MHZ        3       /* flash timing generator 257 - 476 kHz */
+#define FTG_DIV_8MHZ        19
+
+/* function prototypes */
+bool appValid(void);
+void startApp(void);
+void clockSetup(unsigned char baudCode);
+void UARTSetup(unsigned char baudCode);
+char receiveChar(void);
+void transmitChar(char charToTransmit);
+unsigned short crc16Update(unsigned short crc, unsigned char value);
+unsigned char receiveFrame(void);
+void sendReply(unsigned char type, unsigned char status, const unsigned char * data, unsigned char len);
+unsigned char eraseSegment(unsigned short addr);
+unsigned char writeBlock(unsigned short addr, unsigned char len);
+__ramfunc void blockWrite(unsigned char * dst, const unsigned char * src, unsigned char len);
+
+/* shared variables */
+static unsigned char payload[FRAME_MAX_PAYLOAD];    /* payload of the last frame, also the block write source */
+static unsigned char payloadLen;
+static bool synced;                                 /* PC has talked to us, do not time out */
+
+void main(void) {
+  unsigned char type;
+  unsigned char reply[6];
+  unsigned short addr;
+
+  WDTCTL = WDTPW + WDTHOLD;   // Stop WDT
+
+  P2REN = (unsigned char)(~PCCOMM);   /* pull down everything but the cable sense pin */
+  if (!(P2IN & PCCOMM) && appValid()) {
+    startApp();               /* not docked, nothing to do here */
+  }
+
+  P1DIR = DBG0;
+  P1OUT = DBG0;
+  P3SEL = (UARTTX | UARTRX);
+  clockSetup(BAUD_9600);
+  UARTSetup(BAUD_9600);
+
+  /* time out waiting for the PC with timer A */
+  CCR0 = BOOT_WAIT_TICKS - 1;
+  TACTL = TASSEL_1 | ID_3 | TACLR | MC_1;   /* ACLK/8, up mode */
+
+  while (true) {
+    type = receiveFrame();
+    if (type == BOOT_BAD_FRAME) {
+      sendReply(BOOT_BAD_FRAME, BOOT_ERR_FRAME, 0, 0);
+      continue;
+    }
+    synced = true;
+    addr = payload[0] | (payload[1] << 8);
+
+    switch (type) {
+    case BOOT_SYNC:
+      reply[0] = BOOT_VERSION;
+      reply[1] = BLOCK_SIZE;
+      reply[2] = (unsigned char)APP_START;
+      reply[3] = (unsigned char)(APP_START >> 8);
+      reply[4] = (unsigned char)APP_END;
+      reply[5] = (unsigned char)(APP_END >> 8);
+      sendReply(type, BOOT_OK, reply, 6);
+      break;
+
+    case BOOT_BAUD:
+      if (payloadLen != 1 || payload[0] > BAUD_115200) {
+        sendReply(type, BOOT_ERR_COMMAND, 0, 0);
+        break;
+      }
+      sendReply(type, BOOT_OK, 0, 0);
+      while (UCA0STAT & UCBUSY);        /* let the reply go out at the old rate */
+      clockSetup(payload[0]);
+      UARTSetup(payload[0]);
+      break;
+
+    case BOOT_ERASE:
+      sendReply(type, (payloadLen == 2) ? eraseSegment(addr) : BOOT_ERR_COMMAND, 0, 0);
+      break;
+
+    case BOOT_WRITE:
+      sendReply(type, (payloadLen > 2) ? writeBlock(addr, payloadLen - 2) : BOOT_ERR_COMMAND, 0, 0);
+      break;
+
+    case BOOT_CRC:
+      if (payloadLen != 4) {
+        sendReply(type, BOOT_ERR_COMMAND, 0, 0);
+      } else {
+        unsigned short len = payload[2] | (payload[3] << 8);
+        unsigned short crc = CRC16_INIT;
+        while (len--) {
+          crc = crc16Update(crc, *(const unsigned char *)addr++);
+        }
+        reply[0] = (unsigned char)crc;
+        reply[1] = (unsigned char)(crc >> 8);
+        sendReply(type, BOOT_OK, reply, 2);
+      }
+      break;
+
+    case BOOT_GO:
+      if (!appValid()) {
+        sendReply(type, BOOT_ERR_NO_APP, 0, 0);
+        break;
+      }
+      sendReply(type, BOOT_OK, 0, 0);
+      while (UCA0STAT & UCBUSY);
+      startApp();
+      break;
+
+    default:
+      sendReply(type, BOOT_ERR_COMMAND, 0, 0);
+      break;
+    }
+  }
+}
+
+/* *** Application *** */
+
+// the application reset vector points into the application area
+bool appValid(void) {
+  unsigned short reset = APP_RESET_VECTOR;
+  return reset != ERASED_WORD && reset >= APP_START && reset < APP_END;
+}
+
+// put the peripherals used here back to their reset state and jump to the application
+void startApp(void) {
+  UCA0CTL1 = UCSWRST;
+  IFG2 &= ~(UCA0RXIFG | UCA0TXIFG);
+  TACTL = 0;
+  CCR0 = 0;
+  P1DIR = 0;
+  P1OUT = 0;
+  P2REN = 0;
+  P3SEL = 0;
+  clockSetup(BAUD_9600);
+  ((void (*)(void))APP_RESET_VECTOR)();
+}
+
+/* *** Clocks and UART *** */
+
+// DCO and flash timing generator for a baud code
+void clockSetup(unsigned char baudCode) {
+  if (baudCode == BAUD_115200) {
+    DCOCTL = 0;                       /* lowest DCOx and MODx while switching ranges */
+    BCSCTL1 = XT2OFF | CALBC1_8MHZ;
+    DCOCTL = CALDCO_8MHZ;
+    FCTL2 = FWKEY + FSSEL0 + (FTG_DIV_8MHZ - 1);
+  } else {
+    DCOCTL = 0;
+    BCSCTL1 = XT2OFF | CALBC1_1MHZ;
+    DCOCTL = CALDCO_1MHZ;
+    FCTL2 = FWKEY + FSSEL0 + (FTG_DIV_1MHZ - 1);
+  }
+  BCSCTL2 = 0;        /* MCLK = SMCLK = DCOCLK */
+  BCSCTL3 = LFXT1S_2; /* use 10922 Hz VLO */
+}
+
+// configure USCI module for UART mode
+void UARTSetup(unsigned char baudCode)
+{
+  UCA0CTL1 |= UCSWRST;
+  UCA0CTL1 |= UCSSEL_2;                     // BRCLK = SMCLK
+  if (baudCode == BAUD_115200) {
+    UCA0BR0 = 69;                           // 8MHz/115200 = 69.44
+    UCA0MCTL = UCBRS_4;                     // Modulation UCBRSx = 4
+  } else {
+    UCA0BR0 = 104;                          // 1MHz/9600 = 104.166
+    UCA0MCTL = UCBRS0;                      // Modulation UCBRSx = 1
+  }
+  UCA0BR1 = 0x00;
+  UCA0CTL1 &= ~UCSWRST;                     // **Initialize USCI state machine**
+}
+
+// wait for a char; until the PC has synced, start the application if it stays quiet
+char receiveChar(void)
+{
+  while (!(IFG2&UCA0RXIFG)) {
+    if (!synced && (TACTL & TAIFG) && appValid()) {
+      startApp();
+    }
+  }
+  return UCA0RXBUF;
+}
+
+// transmit a single char with the USCI_A module
+void transmitChar(char charToTransmit)
+{
+  while (!(IFG2&UCA0TXIFG));
+  UCA0TXBUF = charToTransmit;
+}
+
+/* *** Frames *** */
+
+// CRC-16-CCITT, one byte at a time
+unsigned short crc16Update(unsigned short crc, unsigned char value)
+{
+  unsigned char i;
+  crc ^= (unsigned short)value << 8;
+  for (i = 0; i < 8; i++) {
+    crc = (crc & 0x8000) ? (crc << 1) ^ CRC16_POLY : (crc << 1);
+  }
+  return crc;
+}
+
+// receive one frame into payload, returns its type or BOOT_BAD_FRAME
+unsigned char receiveFrame(void)
+{
+  unsigned short crc;
+  unsigned char type;
+  unsigned char i;
+
+  while (receiveChar() != FRAME_SOF);       /* hunt for the start of a frame */
+  type = receiveChar();
+  payloadLen = receiveChar();
+  if (payloadLen > FRAME_MAX_PAYLOAD) {
+    return BOOT_BAD_FRAME;
+  }
+  crc = crc16Update(crc16Update(CRC16_INIT, type), payloadLen);
+  for (i = 0; i < payloadLen; i++) {
+    payload[i] = receiveChar();
+    crc = crc16Update(crc, payload[i]);
+  }
+  crc ^= (unsigned char)receiveChar();
+  crc ^= (unsigned short)(unsigned char)receiveChar() << 8;
+  return (crc == 0) ? type : BOOT_BAD_FRAME;
+}
+
+// send a reply frame: status byte followed by len bytes of data
+void sendReply(unsigned char type, unsigned char status, const unsigned char * data, unsigned char len)
+{
+  unsigned short crc = CRC16_INIT;
+  unsigned char i;
+
+  transmitChar(FRAME_SOF);
+  transmitChar(type);
+  transmitChar(len + 1);
+  crc = crc16Update(crc16Update(crc16Update(crc, type), len + 1), status);
+  transmitChar(status);
+  for (i = 0; i < len; i++) {
+    crc = crc16Update(crc, data[i]);
+    transmitChar(data[i]);
+  }
+  transmitChar((char)crc);
+  transmitChar((char)(crc >> 8));
+}
+
+/* *** Flash *** */
+
+// erase one segment of the application area
+unsigned char eraseSegment(unsigned short addr)
+{
+  unsigned short *segPtr = (unsigned short *)addr;
+  unsigned short i;
+
+  if (addr < APP_START || addr >= APP_END || (addr % SEGMENT_SIZE) != 0) {
+    return BOOT_ERR_ADDRESS;
+  }
+  FCTL3 = FWKEY;                            // Clear Lock bit
+  FCTL1 = FWKEY + ERASE;                    // Set Erase bit
+  *segPtr = 0;                              // Dummy write to erase Flash seg
+  FCTL1 = FWKEY;                            // Clear Erase bit
+  FCTL3 = FWKEY + LOCK;                     // Set LOCK bit
+
+  for (i = 0; i < SEGMENT_SIZE / 2; i++) {
+    if (segPtr[i] != ERASED_WORD) {
+      return BOOT_ERR_VERIFY;
+    }
+  }
+  return BOOT_OK;
+}
+
+// program the data after the address in payload into one flash row and verify it
+unsigned char writeBlock(unsigned short addr, unsigned char len)
+{
+  const unsigned char *src = payload + 2;
+  unsigned char *dst = (unsigned char *)addr;
+  unsigned char i;
+
+  if (addr < APP_START || addr >= APP_END || addr + len > APP_END || (addr % BLOCK_SIZE) + len > BLOCK_SIZE) {
+    return BOOT_ERR_ADDRESS;
+  }
+  blockWrite(dst, src, len);
+  for (i = 0; i < len; i++) {
+    if (dst[i] != src[i]) {
+      return BOOT_ERR_VERIFY;
+    }
+  }
+  return BOOT_OK;
+}
+
+// block write of up to one flash row. Flash cannot be read while a block write
+// is in progress, so this runs from RAM and the source has to be in RAM too
+__ramfunc void blockWrite(unsigned char * dst, const unsigned char * src, unsigned char len)
+{
+  FCTL3 = FWKEY;                            // Clear Lock bit
+  FCTL1 = FWKEY + BLKWRT + WRT;             // Enable block write
+  while (len--) {
+    *dst++ = *src++;
+    while (!(FCTL3 & WAIT));                // Wait until the byte is programmed
+  }
+  FCTL1 = FWKEY;                            // Clear BLKWRT and WRT
+  while (FCTL3 & BUSY);                     // Wait for the end of the block write
+  FCTL3 = FWKEY + LOCK;                     // Set LOCK bit
+}
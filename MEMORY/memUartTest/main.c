@@ -1,5 +1,6 @@
 
 #include "msp430.h"
+#include <stdbool.h>
 
 #define DBG0            BIT0
 #define DBG1            BIT1
@@ -7,19 +8,50 @@
 #define UARTTX          BIT5
 #define ONE_DELAY       5000
 
+/* flash write area
+ *
+ * Received bytes are appended to the write area through a small RAM buffer.
+ * A full buffer is programmed byte by byte into locations that are still
+ * erased, and a segment is only erased when the writes enter it and it is not
+ * blank, so the UART rather than erase cycles limits the write rate. Every
+ * programmed byte is read back; a mismatch is reported with '?' instead of the
+ * usual ACK.
+ *
+ * Commands:
+ *  'r' - flush, rewind reading and writing to the start of the area, reply 'R'
+ *        (or '?' if the flush failed, the area is rewound anyway)
+ *  'd' - flush the RAM buffer to flash, reply 'D' (or '?')
+ *  'm' - reply with the next byte of the area, '?' once the end of the area
+ *        has been read
+ *  any other byte is written, reply '!' (or '?'). The byte that fills the RAM
+ *  buffer is only ACKed after the buffer has been programmed.
+ */
+#define WRITE_AREA_START    0xB000
+#define WRITE_AREA_SIZE     2048        /* 4 segments */
+#define SEGMENT_SIZE        512
+#define WRITE_BUFF_SIZE     16          /* bytes collected in RAM before programming */
+#define ERASED_BYTE         0xFF
+
 void UARTSetup(void);
 void UARTSleep(void);
 void transmitChar(char charToTransmit);
-void write_Seg(char* ptr, char value);
+bool flushWriteBuffer(void);
+bool segmentBlank(const unsigned char* segPtr);
+char readArea(unsigned int index);
 char read_Seg(char* ptr, unsigned int index);
 void myDelay(unsigned char units);
 
 // global variable
-unsigned int memIndex;
+unsigned int memIndex;                          /* next byte read with 'm' */
+unsigned int writeIndex;                        /* area offset of writeBuffer[0] */
+unsigned char writeBuffer[WRITE_BUFF_SIZE];     /* bytes waiting to be programmed */
+unsigned char writeBufferCount;
 
 int main( void )
 {
   memIndex = 0;
+  writeIndex = 0;
+  writeBufferCount = 0;
   // Stop watchdog timer to prevent time out reset
   WDTCTL = WDTPW + WDTHOLD;
 
@@ -44,6 +76,9 @@ int main( void )
   BCSCTL2 = 0;
   BCSCTL3 = LFXT1S_2; /* use 10922 Hz VLO with 1pF effective load cap */
   
+  /* *** setup FLASH controller *** */
+  FCTL2 = FWKEY + FSSEL0 + FN1;       /* MCLK/3 for Flash Timing Generator */
+  
   UARTSetup();
   
   __enable_interrupt();   /* enable global interrupts */
@@ -67,18 +102,30 @@ __interrupt void USCI0RX_ISR(void)
   switch(UCA0RXBUF)
   {
   case 'r':
-    transmitChar('R');
+    transmitChar(flushWriteBuffer() ? 'R' : '?');
     memIndex = 0;
+    writeIndex = 0;
     break;
   case 'd':
-    transmitChar('D');
+    transmitChar(flushWriteBuffer() ? 'D' : '?');
     break;
   case 'm':
-    transmitChar(read_Seg((char*)0xB000, memIndex++));
+    if (memIndex < WRITE_AREA_SIZE)
+    {
+      transmitChar(readArea(memIndex++));
+    }
+    else
+    {
+      transmitChar('?');                    // past the end of the area
+    }
     break;
   default:
-    write_Seg((char*)0xB000, UCA0RXBUF);
-    transmitChar('!');
+    writeBuffer[writeBufferCount++] = UCA0RXBUF;
+    if (writeBufferCount == WRITE_BUFF_SIZE && !flushWriteBuffer()) {
+      transmitChar('?');
+    } else {
+      transmitChar('!');
+    }
     break;
   }
 }
@@ -108,27 +155,72 @@ void transmitChar(char charToTransmit)
   UCA0TXBUF = charToTransmit;
 }
 
-void write_Seg(char* ptr, char value)
+// program the RAM buffer into the write area and empty it. A segment is erased
+// only when the buffer reaches its first byte and it is not blank; returns false
+// if a location was not erased or does not read back as written
+bool flushWriteBuffer(void)
 {
-  char *Flash_ptr;
-  unsigned int i;
+  unsigned char *Flash_ptr;
+  unsigned char i;
+  bool ok = true;
   
-  Flash_ptr = ptr;               // Initialize Flash pointer D
-  /* test */
   FCTL3 = FWKEY;                            // Clear Lock bit
-  FCTL1 = FWKEY + ERASE + EEI;              // Set Erase bit, allow interrupts                           
-  // Dummy write to erase Flash seg(s)
-  *Flash_ptr = 0;
-  
-  FCTL1 = FWKEY + WRT;                      // Set WRT bit for write operation
-  for (i = 0; i < 256; i++)
+  for (i = 0; i < writeBufferCount; i++)
   {
-    *Flash_ptr++ = value;                   // Write value to flash
+    Flash_ptr = (unsigned char *)WRITE_AREA_START + writeIndex;
+    if ((writeIndex % SEGMENT_SIZE) == 0 && !segmentBlank(Flash_ptr))
+    {
+      FCTL1 = FWKEY + ERASE;                // Set Erase bit
+      *Flash_ptr = 0;                       // Dummy write to erase Flash seg
+      FCTL1 = FWKEY;                        // Clear Erase bit
+    }
+    if (*Flash_ptr != ERASED_BYTE)
+    {
+      ok = false;                           // only an erased byte can take any value
+    }
+    else if (writeBuffer[i] != ERASED_BYTE)
+    {
+      FCTL1 = FWKEY + WRT;                  // Set WRT bit for write operation
+      *Flash_ptr = writeBuffer[i];          // Write value to flash
+      FCTL1 = FWKEY;                        // Clear WRT bit
+      if (*Flash_ptr != writeBuffer[i])
+      {
+        ok = false;                         // read-back verification failed
+      }
+    }
+    if (++writeIndex == WRITE_AREA_SIZE)
+    {
+      writeIndex = 0;                       // wrap around to the first segment
+    }
   }
-  /* test also */
-  FCTL1 = FWKEY;                            // Clear WRT bit
   FCTL3 = FWKEY + LOCK;                     // Set LOCK bit
+  writeBufferCount = 0;
+  return ok;
+}
+
+// true if every byte of the segment is erased
+bool segmentBlank(const unsigned char* segPtr)
+{
+  unsigned int i;
+  for (i = 0; i < SEGMENT_SIZE; i++)
+  {
+    if (segPtr[i] != ERASED_BYTE)
+    {
+      return false;
+    }
+  }
+  return true;
+}
 
+// byte of the write area, including bytes still waiting in the RAM buffer
+char readArea(unsigned int index)
+{
+  unsigned int offset = index - writeIndex;
+  if (offset < writeBufferCount)
+  {
+    return writeBuffer[offset];
+  }
+  return read_Seg((char*)WRITE_AREA_START, index);
 }
 
 char read_Seg(char* ptr, unsigned int index)
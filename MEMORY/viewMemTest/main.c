@@ -5,65 +5,113 @@
 #define DBG1            BIT1
 #define UARTRX          BIT4
 #define UARTTX          BIT5
-#define ONE_DELAY       5000
+
+/* memory dump service
+ *
+ * The PC sends CMD_DUMP followed by the start address and the length (2 bytes
+ * each, low-order byte first). The range is streamed back as blocks of
+ *
+ *   address (2) | n (1) | n data bytes | CRC-16 (2)
+ *
+ * with n <= DUMP_BLOCK_SIZE and the CRC-16-CCITT taken over address, n and
+ * data. An empty block (n = 0) with the address after the range ends the
+ * dump, so a range running past 0xFFFF is cut short there. Bad blocks are
+ * fetched again by asking for just their range.
+ */
+#define CMD_DUMP        'm'
+#define DUMP_BLOCK_SIZE 64
+#define CRC16_INIT      0xFFFF
+#define CRC16_POLY      0x1021
 
 void UARTSetup(void);
 void UARTSleep(void);
 void transmitChar(char charToTransmit);
+char receiveChar(void);
+unsigned short receive16bit(void);
+unsigned short crc16Update(unsigned short crc, unsigned char value);
+unsigned short transmitCrc(unsigned short crc, unsigned char value);
+void dumpRange(unsigned short addr, unsigned short len);
 void write_Seg(char* ptr, char value);
 char read_Seg(char* ptr, unsigned int index);
-void myDelay(unsigned char units);
 
 int main( void )
 {
-  unsigned int i;
+  unsigned short addr;
+  unsigned short len;
   // Stop watchdog timer to prevent time out reset
   WDTCTL = WDTPW + WDTHOLD;
 
   /* set inputs and outputs */
   P1DIR = DBG0 | DBG1; /* Two LEDs on AMBER are outputs */
   P3DIR = UARTTX;      /* UART TX is an output */
-  
+
   /* set I/O type */
   P3SEL = UARTTX | UARTRX;
-  
-  /* *** setup clocks *** 
-   * 
+
+  /* *** setup clocks ***
+   *
    * XT1 = 10922 Hz (internal VLO)
-   * DCOCLK = 1 MHz, sourced from XT1
-   * 
+   * DCOCLK = 8 MHz, calibrated (needs VCC >= 2.2 V)
+   *
    * MCLK = DCOCLK
-   * SMCLK = XT1
+   * SMCLK = DCOCLK
    * ACLK = XT1
    */
-  DCOCTL = CALDCO_1MHZ;
-  BCSCTL1 = XT2OFF | CALBC1_1MHZ;
+  DCOCTL = CALDCO_8MHZ;
+  BCSCTL1 = XT2OFF | CALBC1_8MHZ;
   BCSCTL2 = 0;
   BCSCTL3 = LFXT1S_2; /* use 10922 Hz VLO with 1pF effective load cap */
-  
+
   UARTSetup();
-  
-  __enable_interrupt();   /* enable global interrupts */
-  
+
   P1OUT |= DBG0;
-  
-  for(i = 0x8000; i < 0xFFFF; i++)
+
+  while (1)                                 /* serve dump requests */
   {
-    P1OUT ^= DBG1;
-    myDelay(2);
-    transmitChar(read_Seg((char*)0x8000, i));
+    if (receiveChar() == CMD_DUMP)
+    {
+      addr = receive16bit();
+      len = receive16bit();
+      P1OUT |= DBG1;
+      dumpRange(addr, len);
+      P1OUT &= ~DBG1;
+    }
   }
-  
+}
+
+// stream [addr, addr + len) as checksummed blocks, back to back at full UART speed
+void dumpRange(unsigned short addr, unsigned short len)
+{
+  unsigned short crc;
+  unsigned char n;
+  unsigned char i;
+
+  if (addr != 0 && len > (unsigned short)(0 - addr)) {
+    len = 0 - addr;                         /* stop at the top of the address space */
+  }
+  do {
+    n = (len > DUMP_BLOCK_SIZE) ? DUMP_BLOCK_SIZE : (unsigned char)len;
+    crc = transmitCrc(CRC16_INIT, (unsigned char)addr);
+    crc = transmitCrc(crc, (unsigned char)(addr >> 8));
+    crc = transmitCrc(crc, n);
+    for (i = 0; i < n; i++) {
+      crc = transmitCrc(crc, read_Seg((char*)addr, i));
+    }
+    transmitChar((char)crc);
+    transmitChar((char)(crc >> 8));
+    addr += n;
+    len -= n;
+  } while (n != 0);                         /* the empty block ends the dump */
 }
 
 // configure USCI module for UART mode
 void UARTSetup(void)
 {
   UCA0CTL1 |= UCSWRST;
-  UCA0CTL1 |= UCSSEL_2;                     // BRCLK = SMCLK
-  UCA0BR0 = 104;                            // 1MHz/9600 = 104.166
+  UCA0CTL1 |= UCSSEL_2;                     // BRCLK = SMCLK = 8MHz
+  UCA0BR0 = 69;                             // 8MHz/115200 = 69.44
   UCA0BR1 = 0x00;                           //
-  UCA0MCTL = UCBRS0;                        // Modulation UCBRSx = 1
+  UCA0MCTL = UCBRS_4;                       // Modulation UCBRSx = 4
   UCA0CTL1 &= ~UCSWRST;                     // **Initialize USCI state machine**
 }
 
@@ -80,6 +128,38 @@ void transmitChar(char charToTransmit)
   UCA0TXBUF = charToTransmit;
 }
 
+// wait for and return a single char from the USCI_A module
+char receiveChar(void)
+{
+  while (!(IFG2&UCA0RXIFG));
+  return UCA0RXBUF;
+}
+
+// receives 16-bit value low-order byte first
+unsigned short receive16bit(void)
+{
+  unsigned short val = (unsigned char)receiveChar();
+  return val | ((unsigned short)(unsigned char)receiveChar() << 8);
+}
+
+// CRC-16-CCITT, one byte at a time
+unsigned short crc16Update(unsigned short crc, unsigned char value)
+{
+  unsigned char i;
+  crc ^= (unsigned short)value << 8;
+  for (i = 0; i < 8; i++) {
+    crc = (crc & 0x8000) ? (crc << 1) ^ CRC16_POLY : (crc << 1);
+  }
+  return crc;
+}
+
+// transmit a byte and add it to the CRC while the USCI shifts it out
+unsigned short transmitCrc(unsigned short crc, unsigned char value)
+{
+  transmitChar(value);
+  return crc16Update(crc, value);
+}
+
 void write_Seg(char* ptr, char value)
 {
   char *Flash_ptr;
@@ -110,11 +190,3 @@ char read_Seg(char* ptr, unsigned int index)
   Flash_ptr = ptr;               // Initialize Flash pointer
   return *(Flash_ptr + index);  
 }
-
-// debugging delay. usually blinking LEDs
-void myDelay(unsigned char units)
-{
-  volatile unsigned int i;
-  unsigned int delayTime = units * ONE_DELAY;
-  for(i = 0; i < delayTime; i++);
-}
\ No newline at end of file
@@ -1,30 +1,29 @@
 
 #include "msp430.h"
 #include "stdbool.h"
+#include "../../namasteTrunk/pins.h"
 
 #define SMCLKO  BIT4    /* P1.4 - output sub master clock SMCLK */
 #define XIN     BIT6    /* P2.6 - XIN for crystal */
 #define XOUT    BIT7    /* P2.7 - XOUT for crystal */
 #define LED     BIT6    /* P3.6 - LED output */
 
+/*                       out low  out high  in  pull-up  peripheral    peripheral out */
+#define P1_MAP  PORT_MAP(0,       0,        0,  0,       0,            SMCLKO)
+#define P2_MAP  PORT_MAP(0,       0,        0,  0,       XIN | XOUT,   0)
+#define P3_MAP  PORT_MAP(LED,     0,        0,  0,       0,            0)
+#include "../../namasteTrunk/pins.h"   /* checks the maps */
+
 int main( void )
 {
   
   // Stop watchdog timer to prevent time out reset
   WDTCTL = WDTPW + WDTHOLD;
 
-  // non digital I/O
-  P1SEL = SMCLKO;
-  P2SEL = XIN | XOUT;
-  
-  // digital I/O
-  P3DIR = LED;
-  P3OUT = 0;
-  
-  // Pull up/down resistors
-  P1REN = (unsigned char)(~(SMCLKO));
-  P2REN = (unsigned char)(~(XIN | XOUT));
-  P3REN = (unsigned char)(~LED);
+  // pins, unused ones pulled down
+  PORT_SETUP(1, P1_MAP);
+  PORT_SETUP(2, P2_MAP);
+  PORT_SETUP(3, P3_MAP);
   
   /* *** setup clocks *** 
   * 
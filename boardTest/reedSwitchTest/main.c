@@ -1,6 +1,7 @@
 
 #include "msp430.h"
 #include "stdbool.h"
+#include "../../namasteTrunk/pins.h"
 
 #define SMCLK   BIT4    /* P1.4 - smclk out */
 
@@ -11,26 +12,22 @@
 
 #define LED     BIT6    /* P3.6 - LED circuit */
 
+/*                       out low  out high  in                pull-up  peripheral    peripheral out */
+#define P1_MAP  PORT_MAP(0,       0,        0,                0,       0,            SMCLK)
+#define P2_MAP  PORT_MAP(0,       0,        PCCOM | SENSEIN,  0,       XIN | XOUT,   0)
+#define P3_MAP  PORT_MAP(LED,     0,        0,                0,       0,            0)
+#include "../../namasteTrunk/pins.h"   /* checks the maps */
+
 int main( void )
 {
   
   // Stop watchdog timer to prevent time out reset
   WDTCTL = WDTPW + WDTHOLD;
   
-  // non digital I/O
-  P1SEL = SMCLK;
-  P1DIR = SMCLK;
-  
-  P2SEL = XIN | XOUT;
-  
-  // LED set up
-  P3DIR = LED;
-  P3OUT = 0;
-  
-  // Pull up/down resistors
-  P1REN = (unsigned char)(~SMCLK);
-  P2REN = (unsigned char)(~(PCCOM | XIN | XOUT | SENSEIN));
-  P3REN = (unsigned char)(~(LED));
+  // pins, unused ones pulled down
+  PORT_SETUP(1, P1_MAP);
+  PORT_SETUP(2, P2_MAP);
+  PORT_SETUP(3, P3_MAP);
   
   /* *** setup clocks *** 
   * 
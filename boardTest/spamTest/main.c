@@ -7,6 +7,7 @@ Turns on LEDs and sends back data depending on options sent by Python script
 */
 
 #include "msp430.h"
+#include "../../namasteTrunk/pins.h"
 
 #define DBG0    BIT0    /* P1.0 - general debug */
 
@@ -17,6 +18,12 @@ Turns on LEDs and sends back data depending on options sent by Python script
 #define UARTRX  BIT5    /* P3.5 - UART Rx pin */
 #define LED     BIT6    /* P3.6 - LED VCC */
 
+/*                       out low  out high  in  pull-up  peripheral        peripheral out */
+#define P1_MAP  PORT_MAP(0,       DBG0,     0,  0,       0,                0)
+#define P2_MAP  PORT_MAP(0,       0,        0,  0,       XIN | XOUT,       0)
+#define P3_MAP  PORT_MAP(LED,     0,        0,  0,       UARTTX | UARTRX,  0)
+#include "../../namasteTrunk/pins.h"   /* checks the maps */
+
 /*
 this main demonstrates UART in several different ways. Use to develop functions
 using UART module to replace bit banging.
@@ -45,19 +52,9 @@ void UARTSetup( void )
   BCSCTL2 = SELS; /* SMCLK = ACLK */
   BCSCTL3 = LFXT1S_0 | XCAP_1; /* use 32768 Hz XT1 with 6pF effective load cap */
   
-  P1DIR = DBG0;
-  P1OUT = DBG0;
-  
-  P2DIR = 0;
-  P2SEL = XIN | XOUT;
-  
-  P3DIR = LED;
-  P3SEL = UARTTX | UARTRX;                  // P3.4,5 = USCI_A0 TXD/RXD
-  P3OUT = 0;
-  
-  P1REN = (unsigned char)(~DBG0);
-  P2REN = (unsigned char)(~(XIN | XOUT));
-  P3REN = (unsigned char)(~(LED | UARTTX | UARTRX));
+  PORT_SETUP(1, P1_MAP);
+  PORT_SETUP(2, P2_MAP);
+  PORT_SETUP(3, P3_MAP);                    // P3.4,5 = USCI_A0 TXD/RXD
 
   // configure UCSI module for UART mode
   UCA0CTL1 |= UCSWRST;
@@ -0,0 +1,127 @@
+/*
+    logTest.c
+    Host test of the timestamp log search (findRange() in namasteTrunk/main.c)
+
+    Builds the firmware with msp430.h from this directory in place of the
+    device header and includes main.c and sched.c, with the flash log as
+    plain memory. Records are stored through recordEvent() as in SENSE
+    mode, then findRange() is checked against the records it should select,
+    including records with the same time on both sides of a block boundary.
+
+    Build:  gcc -Wall -O2 -I. -o logTest logTest.c
+    Usage:  logTest, exits 1 if a check fails
+*/
+
+#include <stdio.h>
+
+#define main firmwareMain       /* the firmware's main() */
+#define const                   /* the flash segments are written as memory */
+#include "../namasteTrunk/main.c"
+#include "../namasteTrunk/sched.c"
+#undef const
+#undef main
+
+static int failures;
+
+#define CHECK(cond) do { \
+          if (!(cond)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+          } \
+        } while (0)
+
+/* record times, three flash blocks and the RAM buffer. Block 1 starts at 1000
+ * like the last two records of block 0, block 2 starts at 1700 after a block
+ * that ends below it */
+static const unsigned long times[] = {
+  100, 200, 300, 400, 500, 600, 1000, 1000,
+  1000, 1000, 1100, 1200, 1300, 1400, 1500, 1600,
+  1700, 1800, 1900, 2000, 2100, 2200, 2300, 2400,
+  2500, 2600
+};
+#define RECORDS     (sizeof(times) / sizeof(times[0]))
+
+// a fresh log holding the records of times in edge blocks
+static void fillLog(void) {
+  unsigned char i;
+  params.storageMode = STORE_EDGES;
+  params.senseSeconds = 15;
+  mode = SENSEMODE;
+  clearTimestamps();
+  curTimestamp = 1000000;               /* far past the records, too old for a bitmap block */
+  for (i = 0; i < RECORDS; i++) {
+    recordEvent(0, (i & 1) ? MAT_CLOSED : MAT_OPEN, times[i]);
+  }
+}
+
+// findRange() selects the records from first to last, and the walk with 'e'
+// starts at the first of them
+static void checkRange(unsigned long first, unsigned long last) {
+  unsigned short expected = 0;
+  unsigned short start = 0;
+  unsigned short count;
+  unsigned short i;
+
+  for (i = RECORDS; i-- > 0; ) {
+    if (times[i] >= first && times[i] <= last) {
+      expected++;
+      start = i;
+    }
+  }
+  count = findRange(first, last);
+  if (count != expected) {
+    printf("range %lu-%lu: %u records, expected %u\n", first, last, count, expected);
+    failures++;
+    return;
+  }
+  for (i = 0; i < count; i++) {
+    CHECK((getTimestamp(i) & TIMESTAMP_MASK) == times[start + i]);
+  }
+}
+
+// the log holds the records as three flash blocks and the RAM buffer
+static void testLog(void) {
+  unsigned short i;
+  fillLog();
+  CHECK(timeStorIndex == 3 * TIMESTAMP_BUFF_SIZE && bitmapBlocks == 0);
+  CHECK(getNumTimestamps() == RECORDS);
+  for (i = 0; i < RECORDS; i++) {
+    CHECK((getTimestamp(i) & TIMESTAMP_MASK) == times[i]);
+  }
+}
+
+// equal times across the boundary of blocks 0 and 1: the range starts in block 0
+static void testEqualTimes(void) {
+  fillLog();
+  checkRange(1000, 1000);
+  checkRange(1000, 1100);
+  checkRange(700, 1000);
+  checkRange(1000, 0x7FFFFFFF);
+}
+
+// ranges that start before the first record, at a block start, inside a block,
+// in the RAM buffer, and past the last record
+static void testRanges(void) {
+  fillLog();
+  checkRange(0, 0x7FFFFFFF);
+  checkRange(0, 150);
+  checkRange(100, 100);
+  checkRange(1650, 1800);
+  checkRange(1700, 1700);
+  checkRange(1250, 1450);
+  checkRange(2450, 2600);
+  checkRange(2601, 3000);
+  checkRange(650, 950);
+}
+
+int main(void) {
+  testLog();
+  testEqualTimes();
+  testRanges();
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all log checks passed\n");
+  return 0;
+}
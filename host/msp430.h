@@ -0,0 +1,141 @@
+/*
+    msp430.h
+    Host stand-in for the IAR device header of the MSP430F2274
+
+    Lets a host test build the firmware sources (namasteTrunk/main.c and
+    sched.c) with gcc, as host/logTest.c does: the registers are plain
+    variables that start at 0, the intrinsics do nothing, and the IAR
+    keywords and pragmas are dropped. Only what the firmware uses is here.
+    Include it in one translation unit, with -I. from host/.
+*/
+
+#ifndef HOST_MSP430_H
+#define HOST_MSP430_H
+
+#pragma GCC diagnostic ignored "-Wunknown-pragmas"     /* vector= and location= */
+
+#define __interrupt
+
+static inline void __delay_cycles(unsigned long cycles) { (void)cycles; }
+static inline void __enable_interrupt(void) {}
+static inline void __disable_interrupt(void) {}
+static inline void __low_power_mode_0(void) {}
+static inline void __low_power_mode_3(void) {}
+static inline void __low_power_mode_4(void) {}
+static inline void __low_power_mode_off_on_exit(void) {}
+
+/* registers */
+#define HOST_R8(name)   static volatile unsigned char name;
+#define HOST_R16(name)  static volatile unsigned short name;
+
+HOST_R8(P1IN) HOST_R8(P1OUT) HOST_R8(P1DIR) HOST_R8(P1SEL) HOST_R8(P1REN)
+HOST_R8(P2IN) HOST_R8(P2OUT) HOST_R8(P2DIR) HOST_R8(P2SEL) HOST_R8(P2REN)
+HOST_R8(P2IFG) HOST_R8(P2IES) HOST_R8(P2IE)
+HOST_R8(P3IN) HOST_R8(P3OUT) HOST_R8(P3DIR) HOST_R8(P3SEL) HOST_R8(P3REN)
+HOST_R8(P4IN) HOST_R8(P4OUT) HOST_R8(P4DIR) HOST_R8(P4SEL) HOST_R8(P4REN)
+HOST_R8(DCOCTL) HOST_R8(BCSCTL1) HOST_R8(BCSCTL2) HOST_R8(BCSCTL3)
+HOST_R8(IFG1) HOST_R8(IE1) HOST_R8(IFG2) HOST_R8(IE2)
+HOST_R16(WDTCTL) HOST_R16(FCTL1) HOST_R16(FCTL2) HOST_R16(FCTL3)
+HOST_R16(TACTL) HOST_R16(TAR) HOST_R16(TAIV)
+HOST_R16(CCTL0) HOST_R16(CCTL1) HOST_R16(CCTL2) HOST_R16(CCR0) HOST_R16(CCR1) HOST_R16(CCR2)
+HOST_R16(TBCTL) HOST_R16(TBR) HOST_R16(TBCCTL0) HOST_R16(TBCCR0)
+HOST_R8(UCA0CTL1) HOST_R8(UCA0BR0) HOST_R8(UCA0BR1) HOST_R8(UCA0MCTL) HOST_R8(UCA0STAT)
+HOST_R8(UCA0RXBUF) HOST_R8(UCA0TXBUF)
+HOST_R16(ADC10CTL0) HOST_R16(ADC10CTL1) HOST_R16(ADC10MEM) HOST_R8(ADC10AE0)
+
+/* calibration constants in information memory segment A */
+static const unsigned char CALDCO_1MHZ = 0, CALBC1_1MHZ = 0, CALDCO_8MHZ = 0, CALBC1_8MHZ = 0;
+
+#define BIT0            0x01
+#define BIT1            0x02
+#define BIT2            0x04
+#define BIT3            0x08
+#define BIT4            0x10
+#define BIT5            0x20
+#define BIT6            0x40
+#define BIT7            0x80
+
+/* watchdog */
+#define WDTPW           0x5A00
+#define WDTHOLD         0x0080
+#define WDTTMSEL        0x0010
+#define WDTCNTCL        0x0008
+#define WDTSSEL         0x0004
+#define WDTIS0          0x0001
+#define WDT_ADLY_1000   (WDTPW + WDTTMSEL + WDTCNTCL + WDTSSEL)
+#define WDT_ADLY_250    (WDTPW + WDTTMSEL + WDTCNTCL + WDTSSEL + WDTIS0)
+
+/* special function registers */
+#define WDTIE           0x01
+#define WDTIFG          0x01
+#define OFIE            0x02
+#define OFIFG           0x02
+#define UCA0RXIE        0x01
+#define UCA0TXIFG       0x02
+
+/* basic clock */
+#define XT2OFF          0x80
+#define LFXT1S_0        0x00
+#define LFXT1S_2        0x20
+#define XCAP_1          0x04
+#define XCAP_3          0x0C
+#define XT2OF           0x02
+#define LFXT1OF         0x01
+
+/* flash */
+#define FWKEY           0xA500
+#define ERASE           0x0002
+#define WRT             0x0040
+#define FSSEL0          0x0040
+#define LOCK            0x0010
+#define LOCKA           0x0040
+
+/* timer A and timer B */
+#define TASSEL_1        0x0100
+#define TASSEL_2        0x0200
+#define TBSSEL_0        0x0000
+#define ID_0            0x0000
+#define ID_1            0x0040
+#define ID_2            0x0080
+#define ID_3            0x00C0
+#define MC_1            0x0010
+#define MC_2            0x0020
+#define TACLR           0x0004
+#define TBCLR           0x0004
+#define TAIE            0x0002
+#define TAIFG           0x0001
+#define TBIFG           0x0001
+#define CCIE            0x0010
+#define OUT             0x0004
+#define CCIFG           0x0001
+#define TAIV_TACCR1     2
+#define TAIV_TACCR2     4
+#define TAIV_TAIFG      10
+
+/* USCI_A0 */
+#define UCSWRST         0x01
+#define UCSSEL_1        0x40
+#define UCSSEL_2        0x80
+#define UCBUSY          0x01
+
+/* ADC10 */
+#define ADC10SHT_2      0x1000
+#define SREF_0          0x0000
+#define ADC10ON         0x0010
+#define ENC             0x0002
+#define ADC10SC         0x0001
+#define INCH_1          0x1000
+#define ADC10SSEL_0     0x0000
+#define ADC10DIV_0      0x0000
+#define ADC10BUSY       0x0001
+
+/* interrupt vectors */
+#define PORT2_VECTOR        6
+#define USCIAB0RX_VECTOR    14
+#define TIMERA1_VECTOR      16
+#define TIMERA0_VECTOR      18
+#define WDT_VECTOR          20
+#define TIMERB0_VECTOR      26
+#define NMI_VECTOR          28
+
+#endif
@@ -0,0 +1,365 @@
+/*
+    namasteConfig.c
+    Reads and changes the sensing parameters of a docked namasteTrunk board
+
+    Reads the parameters with 'g' and the log summary with 'u' (events,
+    first and last event time, occupied time, dropped and filtered counts),
+    which is enough to tell whether a full download is worth it. With -A
+    the sensor is read a number of times with 'a', which gives the ADC10
+    readings of an open and of a closed mat to put the analog thresholds
+    between. If any
+    option asks for a change, writes the parameters back with 'c'. The device checks them against its timer
+    limits, saves them in information memory and uses them from then on:
+    the cable counts right away, the sense period when it next enters SENSE
+    mode. The device is left in UART mode, so run namasteDock afterwards to
+    set its time.
+
+    Build:  gcc -Wall -O2 -o namasteConfig namasteConfig.c namasteProto.c
+    Usage:  namasteConfig [-s 15] [-i 2] [-o 2] [-c 1] [-l 0] [-m edges|occupancy|counts] [-H 1]
+                          [-a digital|analog] [-T 341,682] [-A 10] /dev/ttyUSB0
+*/
+
+#define _GNU_SOURCE
+#include "namasteProto.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/* defaults */
+#define REPLY_TIMEOUT_MS    1000
+#define DOCK_WAIT_MS        500     /* DOCK_STABLE_MS plus margin */
+#define MAX_TRIES           3
+
+// read exactly len bytes, returns -1 on timeout
+static int readExact(int fd, unsigned char *buf, size_t len) {
+  struct pollfd pfd;
+  size_t got = 0;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  while (got < len) {
+    ssize_t n;
+    if (poll(&pfd, 1, REPLY_TIMEOUT_MS) <= 0) {
+      return -1;
+    }
+    n = read(fd, buf + got, len - got);
+    if (n < 0 && errno != EINTR && errno != EAGAIN) {
+      return -1;
+    }
+    if (n > 0) {
+      got += (size_t)n;
+    }
+  }
+  return 0;
+}
+
+// send a one byte command and read its fixed size reply
+static int query(int fd, unsigned char cmd, unsigned char *reply, size_t len) {
+  int tries;
+
+  for (tries = 0; tries < MAX_TRIES; tries++) {
+    tcflush(fd, TCIFLUSH);
+    if (write(fd, &cmd, 1) != 1) {
+      return -1;
+    }
+    if (readExact(fd, reply, len) == 0) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// returns the device's ACK or NAK, -1 if it did not answer
+static int setConfig(int fd, const unsigned char *cfg) {
+  unsigned char buf[1 + CONFIG_BYTES];
+  unsigned char reply;
+
+  buf[0] = CMD_SET_CONFIG;
+  memcpy(buf + 1, cfg, CONFIG_BYTES);
+  tcflush(fd, TCIFLUSH);
+  if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+    return -1;
+  }
+  /* the reply comes after a segment erase, well within the timeout */
+  if (readExact(fd, &reply, 1) < 0) {
+    return -1;
+  }
+  return reply;
+}
+
+// reads the 'u' frame into payload, returns -1 if it did not arrive intact
+static int getSummary(int fd, unsigned char *payload) {
+  unsigned char buf[FRAME_OVERHEAD + SUMMARY_BYTES];
+  struct frameDecoder dec;
+  size_t i;
+
+  if (query(fd, CMD_SUMMARY, buf, sizeof(buf)) < 0) {
+    return -1;
+  }
+  frameReset(&dec);
+  for (i = 0; i < sizeof(buf); i++) {
+    if (frameFeed(&dec, buf[i]) == 1 && dec.type == FRAME_SUMMARY && dec.len == SUMMARY_BYTES) {
+      memcpy(payload, dec.payload, SUMMARY_BYTES);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static void printTime(uint32_t ts) {
+  time_t t = (time_t)ts;
+  char buf[32];
+  strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&t));
+  fputs(buf, stdout);
+}
+
+static void printSummary(const unsigned char *sum) {
+  printf("events: %u", get16le(sum));
+  if (get16le(sum) != 0) {
+    printf(" from ");
+    printTime(get32le(sum + 2));
+    printf(" to ");
+    printTime(get32le(sum + 6));
+  }
+  printf(", occupied %lu s, dropped (storage full) %u, filtered %u\n",
+         (unsigned long)get32le(sum + 10), get16le(sum + 14), get16le(sum + 16));
+}
+
+// read the sensor n times and print the range of the readings
+static int readSensor(int fd, long n) {
+  unsigned char reply[ADC_BYTES];
+  unsigned int lo = ADC_MAX, hi = 0;
+  unsigned long sum = 0;
+  long i;
+
+  for (i = 0; i < n; i++) {
+    unsigned int value;
+    if (query(fd, CMD_ADC, reply, sizeof(reply)) < 0) {
+      return -1;
+    }
+    value = get16le(reply);
+    sum += value;
+    lo = value < lo ? value : lo;
+    hi = value > hi ? value : hi;
+  }
+  printf("sensor: %ld readings, min %u, mean %lu, max %u (of %d)\n", n, lo, sum / n, hi, ADC_MAX);
+  return 0;
+}
+
+static void printConfig(const char *what, const unsigned char *cfg) {
+  printf("%s: version %u, sense period %u s, cable in %u x 200 ms, cable out %u s, "
+         "confirm %u samples, dwell %u samples, %u channel%s, ", what, cfg[0], cfg[1], cfg[2], cfg[3], cfg[4],
+         cfg[5], cfg[8], cfg[8] == 1 ? "" : "s");
+  if (cfg[9] == SENSE_ANALOG) {
+    printf("analog closed <= %u, open >= %u, ", get16le(cfg + 10), get16le(cfg + 12));
+  } else {
+    printf("digital, ");
+  }
+  if (cfg[6] == STORE_OCCUPANCY) {
+    printf("occupancy per %u h\n", cfg[7]);
+  } else if (cfg[6] == STORE_COUNTS) {
+    printf("presses per %u h\n", cfg[7]);
+  } else {
+    printf("edges\n");
+  }
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [options] PORT\n"
+          "  -s SEC    sense period in seconds, 1 .. %d (default %d)\n"
+          "  -i N      200 ms cycles the cable must be in before UART mode (default %d)\n"
+          "  -o N      1 s cycles the cable must be out before SENSE mode (default %d)\n"
+          "  -c N      samples in a row a new mat state needs (default %d)\n"
+          "  -l N      further samples a new mat state must last to be recorded (default %d)\n"
+          "  -m MODE   storage mode, edges, occupancy or counts (default edges)\n"
+          "  -H HOURS  occupancy or count bucket length, 1 .. %d (default %d)\n"
+          "  -a MODE   sense mode, digital or analog (default digital)\n"
+          "  -T C,O    analog thresholds: closed at or below C, open at or above O (default %d,%d)\n"
+          "  -A N      read the sensor N times and print the range of the readings\n"
+          "  -D        restore the defaults\n"
+          "  -w MS     wait after opening the port before the first command (default %d)\n",
+          prog, CONFIG_SENSE_MAX, CONFIG_DEFAULT_SENSE, CONFIG_DEFAULT_WAIT_HIGH,
+          CONFIG_DEFAULT_DONE_LOW, CONFIG_DEFAULT_CONFIRM, CONFIG_DEFAULT_DWELL,
+          CONFIG_BUCKET_HOURS_MAX, CONFIG_DEFAULT_BUCKET_HOURS, CONFIG_DEFAULT_CLOSED, CONFIG_DEFAULT_OPEN,
+          DOCK_WAIT_MS);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned char cfg[CONFIG_BYTES];
+  unsigned char sum[SUMMARY_BYTES];
+  long sense = -1, waitHigh = -1, doneLow = -1, confirm = -1, dwell = -1, storage = -1, bucket = -1;
+  long senseMode = -1, closedBelow = -1, openAbove = -1, readings = 0;
+  unsigned char oldStorage;
+  bool defaults = false;
+  int waitMs = DOCK_WAIT_MS;
+  int fd, opt, reply;
+
+  while ((opt = getopt(argc, argv, "s:i:o:c:l:m:H:a:T:A:Dw:h")) != -1) {
+    switch (opt) {
+    case 's': sense = strtol(optarg, NULL, 0); break;
+    case 'i': waitHigh = strtol(optarg, NULL, 0); break;
+    case 'o': doneLow = strtol(optarg, NULL, 0); break;
+    case 'c': confirm = strtol(optarg, NULL, 0); break;
+    case 'l': dwell = strtol(optarg, NULL, 0); break;
+    case 'm':
+      if (strcmp(optarg, "edges") == 0) {
+        storage = STORE_EDGES;
+      } else if (strcmp(optarg, "occupancy") == 0) {
+        storage = STORE_OCCUPANCY;
+      } else if (strcmp(optarg, "counts") == 0) {
+        storage = STORE_COUNTS;
+      } else {
+        usage(argv[0]);
+        return 2;
+      }
+      break;
+    case 'H': bucket = strtol(optarg, NULL, 0); break;
+    case 'a':
+      if (strcmp(optarg, "digital") == 0) {
+        senseMode = SENSE_DIGITAL;
+      } else if (strcmp(optarg, "analog") == 0) {
+        senseMode = SENSE_ANALOG;
+      } else {
+        usage(argv[0]);
+        return 2;
+      }
+      break;
+    case 'T':
+      if (sscanf(optarg, "%ld,%ld", &closedBelow, &openAbove) != 2) {
+        usage(argv[0]);
+        return 2;
+      }
+      break;
+    case 'A': readings = strtol(optarg, NULL, 0); break;
+    case 'D': defaults = true; break;
+    case 'w': waitMs = atoi(optarg); break;
+    default:
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (optind + 1 != argc) {
+    usage(argv[0]);
+    return 2;
+  }
+  if ((sense != -1 && (sense < 1 || sense > CONFIG_SENSE_MAX)) ||
+      (waitHigh != -1 && (waitHigh < 1 || waitHigh > 255)) ||
+      (doneLow != -1 && (doneLow < 1 || doneLow > 255)) ||
+      (confirm != -1 && (confirm < 1 || confirm > 255)) ||
+      (dwell != -1 && (dwell < 0 || dwell > 255)) ||
+      (bucket != -1 && (bucket < 1 || bucket > CONFIG_BUCKET_HOURS_MAX)) ||
+      (closedBelow != -1 && (closedBelow < 0 || openAbove <= closedBelow || openAbove > ADC_MAX)) || readings < 0) {
+    fprintf(stderr, "parameter out of range\n");
+    return 2;
+  }
+
+  fd = open(argv[optind], O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0 || setRawMode(fd, NAMASTE_BAUD) < 0) {
+    perror(argv[optind]);
+    return 1;
+  }
+  poll(NULL, 0, waitMs);            /* device enters UART mode once the cable is stable */
+
+  if (query(fd, CMD_GET_CONFIG, cfg, CONFIG_BYTES) < 0) {
+    fprintf(stderr, "no reply to '%c'\n", CMD_GET_CONFIG);
+    return 1;
+  }
+  if (cfg[0] != CONFIG_VERSION) {
+    fprintf(stderr, "unknown parameter version %u\n", cfg[0]);
+    return 1;
+  }
+  printConfig("device", cfg);
+  if (getSummary(fd, sum) == 0) {
+    printSummary(sum);
+  } else {
+    fprintf(stderr, "no summary ('%c')\n", CMD_SUMMARY);
+  }
+  if (readings > 0 && readSensor(fd, readings) < 0) {
+    fprintf(stderr, "no reply to '%c'\n", CMD_ADC);
+    return 1;
+  }
+  if (!defaults && sense == -1 && waitHigh == -1 && doneLow == -1 && confirm == -1 && dwell == -1 &&
+      storage == -1 && bucket == -1 && senseMode == -1 && closedBelow == -1) {
+    return 0;
+  }
+  oldStorage = cfg[6];
+
+  if (defaults) {
+    cfg[1] = CONFIG_DEFAULT_SENSE;
+    cfg[2] = CONFIG_DEFAULT_WAIT_HIGH;
+    cfg[3] = CONFIG_DEFAULT_DONE_LOW;
+    cfg[4] = CONFIG_DEFAULT_CONFIRM;
+    cfg[5] = CONFIG_DEFAULT_DWELL;
+    cfg[6] = CONFIG_DEFAULT_STORAGE;
+    cfg[7] = CONFIG_DEFAULT_BUCKET_HOURS;
+    cfg[9] = CONFIG_DEFAULT_SENSE_MODE;
+  }                                   /* the channel count and the calibration are the device's own */
+  if (sense != -1) {
+    cfg[1] = (unsigned char)sense;
+  }
+  if (waitHigh != -1) {
+    cfg[2] = (unsigned char)waitHigh;
+  }
+  if (doneLow != -1) {
+    cfg[3] = (unsigned char)doneLow;
+  }
+  if (confirm != -1) {
+    cfg[4] = (unsigned char)confirm;
+  }
+  if (dwell != -1) {
+    cfg[5] = (unsigned char)dwell;
+  }
+  if (storage != -1) {
+    cfg[6] = (unsigned char)storage;
+  }
+  if (bucket != -1) {
+    cfg[7] = (unsigned char)bucket;
+  }
+  if (senseMode != -1) {
+    cfg[9] = (unsigned char)senseMode;
+  }
+  if (closedBelow != -1) {
+    put16le(cfg + 10, (uint16_t)closedBelow);
+    put16le(cfg + 12, (uint16_t)openAbove);
+  }
+  if (cfg[7] * 3600UL / cfg[1] > BUCKET_COUNT_MAX) {
+    fprintf(stderr, "a %u h bucket holds too many %u s samples\n", cfg[7], cfg[1]);
+    return 2;
+  }
+  if ((cfg[6] != STORE_EDGES || cfg[9] == SENSE_ANALOG) && cfg[8] > 1) {
+    fprintf(stderr, "buckets and analog sensing need a device with a single channel\n");
+    return 2;
+  }
+  if (cfg[6] != oldStorage) {         /* the log is decoded with the current mode */
+    unsigned char count[COUNT_BYTES];
+    if (query(fd, CMD_DOWNLOAD, count, sizeof(count)) < 0 || get16le(count) != 0) {
+      fprintf(stderr, "download and erase the records on the device (namasteDock -r) "
+              "before changing the storage mode\n");
+      return 1;
+    }
+  }
+  reply = setConfig(fd, cfg);
+  if (reply == NAK_VALUE) {
+    fprintf(stderr, "device rejected the parameters\n");
+    return 1;
+  } else if (reply != ACK_VALUE) {
+    fprintf(stderr, "no ACK for '%c'\n", CMD_SET_CONFIG);
+    return 1;
+  }
+  if (query(fd, CMD_GET_CONFIG, cfg, CONFIG_BYTES) < 0) {
+    fprintf(stderr, "no reply to '%c'\n", CMD_GET_CONFIG);
+    return 1;
+  }
+  printConfig("saved", cfg);
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,692 @@
+/*
+    namasteDock.c
+    Parallel dock station downloader
+
+    Drains many docked boards at once. Every serial port gets its own session
+    state machine (download, optional reset, time set) and a single epoll loop
+    drives all of them, so total dock time follows the slowest board instead of
+    the sum of all boards. Records of every device are appended to one shared
+    output store as soon as the download of each device completes, before the
+    device is erased or its time set.
+
+    Each session starts by reading the device clock with 't'. With -S, the
+    clock sample taken when the time is set is kept in a sync directory, named
+    by the time sent. 't' also returns the time the device was last set to, so
+    the session finds the sample of that device's own time set whichever port
+    it was on, the drift between the two samples is fitted and every record of
+    the interval gets a corrected timestamp in the store. Firmware that does
+    not return that time gets no drift correction.
+
+    Before the time is set the session pings the device a few times with 'p'
+    and keeps the exchange with the smallest round trip. Its one-way latency
+    tells when the following 'Q' reaches the device, and the host sends the
+    time of that instant with its sub-second phase, so the device clock starts
+    out within a fraction of the USB latency of the host clock. Devices that
+    do not answer 't' get the plain whole-second 'q'.
+
+    The sensing parameters are read with 'g' before the download. Devices in
+    occupancy storage mode are stored as one row per bucket, with "O" in the
+    state column, the bucket start as the timestamp and the occupied seconds
+    in a sixth column. Devices in count storage mode are stored the same
+    way with "P" and the number of presses. Records of devices with several sensor channels are
+    stored under "port#channel", their 28-bit times completed from the
+    device clock read at this dock.
+
+    With -f only the records from one time to another are fetched: 'f'
+    replaces 'd', and the device binary searches its log and lets 'e' walk
+    just that range, which is quicker than a full download when looking
+    into a single incident.
+
+    With -F the session asks the device for 115200 baud with 'b' after 'g'.
+    The device runs its DCO at 8 MHz for the rest of the session and drops
+    back to 9600 baud and 1 MHz when the time is set, so -F needs the time
+    set (not -n). Devices that do not answer 'b' are downloaded at 9600.
+
+    Build:  gcc -Wall -O2 -o namasteDock namasteDock.c namasteDrift.c namasteProto.c -lm
+    Usage:  namasteDock [-o store.csv] [-S syncdir] [-r] [-n] [-F] [-f from,to] /dev/ttyUSB0 /dev/ttyUSB1 ...
+*/
+
+#define _GNU_SOURCE
+#include "namasteDrift.h"
+#include "namasteProto.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <termios.h>
+#include <unistd.h>
+
+/* session states */
+#define SESS_DOCKWAIT   0       /* waiting for the device to enter UART mode */
+#define SESS_CLOCK      1       /* sent 't', waiting for the 14-byte clock reading */
+#define SESS_COUNT      2       /* sent 'd', waiting for the 2-byte count */
+#define SESS_RECORD     3       /* sent 'e', waiting for a 4-byte record */
+#define SESS_RESET      4       /* sent 'r', waiting for ACK */
+#define SESS_PING       5       /* sent 'p', waiting for the 8-byte ping reply */
+#define SESS_QUIT       6       /* sent 'q' or 'Q', waiting for ACK */
+#define SESS_CONFIG     7       /* sent 'g', waiting for the sensing parameters */
+#define SESS_BAUD       8       /* sent 'b', waiting for ACK at the old rate */
+#define SESS_DONE       9
+#define SESS_FAILED     10
+
+/* defaults */
+#define DEFAULT_TIMEOUT_MS  1000    /* per reply; the 'r' erase is well under this */
+#define DEFAULT_RETRIES     3       /* download restarts per device */
+#define PING_COUNT          8       /* round trips measured before the time is set */
+#define MAX_EVENTS          64
+
+struct session {
+  const char *port;
+  int fd;
+  unsigned long baud;               /* rate of the port, raised by 'b' */
+  unsigned char state;
+  unsigned char rxBuf[CONFIG_BYTES];   /* longest reply */
+  unsigned char rxLen;
+  unsigned char rxWant;
+  unsigned short numRecords;
+  unsigned short nextRecord;
+  uint32_t *records;
+  unsigned int retries;
+  double deadline;
+  double startTime;
+  double endTime;
+  unsigned long bytesIn;
+  unsigned long bytesOut;
+  const char *error;
+  double cmdSentAt;                 /* host time the last command was written */
+  struct clockSample clockRead;     /* device clock read with 't' or 'p' at this dock */
+  struct driftFit fit;
+  bool haveFit;
+  struct clockSample clockSet;      /* device clock set with 'q' or 'Q' at this dock */
+  bool timeSet;
+  uint16_t ticksPerSec;             /* unit of the device phase, 0 if 't' was not answered */
+  uint32_t lastSetSeconds;          /* time the device was last set to, from 't', 0 if unknown */
+  uint16_t lastSetPhase;
+  uint32_t setSeconds;              /* time sent with 'q' or 'Q' at this dock, names the sync file */
+  uint16_t setPhase;
+  bool clockUnset;                  /* the device reported 0 seconds, its time was never set */
+  unsigned char pings;
+  struct pingSample ping;           /* exchange with the smallest round trip so far */
+  bool havePing;
+  unsigned char storageMode;        /* how to decode the records, STORE_EDGES unless 'g' says otherwise */
+  unsigned char senseSeconds;
+  unsigned char bucketHours;
+  unsigned char channels;           /* sensor channels, records carry a channel when more than 1 */
+};
+
+struct dockConfig {
+  bool doReset;
+  bool doQuit;
+  double timeout;
+  double dockWait;
+  unsigned int maxRetries;
+  unsigned long baud;
+  bool fastBaud;                    /* switch to NAMASTE_FAST_BAUD with 'b' for the download */
+  const char *syncDir;              /* where the clock sample of every time set is kept */
+  bool useRange;                    /* fetch with 'f' instead of 'd' */
+  uint32_t rangeFirst;
+  uint32_t rangeLast;
+  FILE *out;                        /* shared store, -o */
+};
+
+static struct dockConfig cfg = {
+  false, true, DEFAULT_TIMEOUT_MS / 1000.0, (DOCK_STABLE_MS + 100) / 1000.0,
+  DEFAULT_RETRIES, NAMASTE_BAUD, false, NULL, false, 0, 0, NULL
+};
+
+static void storeRecords(FILE *out, const struct session *s);
+
+/* *** session helpers *** */
+
+static void sessFail(struct session *s, const char *why) {
+  s->state = SESS_FAILED;
+  s->error = why;
+  s->endTime = monoSeconds();
+}
+
+static bool sessSend(struct session *s, const unsigned char *buf, size_t len) {
+  ssize_t n = write(s->fd, buf, len);
+  if (n != (ssize_t)len) {
+    sessFail(s, "write failed");
+    return false;
+  }
+  s->bytesOut += len;
+  return true;
+}
+
+// send a one-byte command and expect a reply of replyLen bytes
+static void sessCommand(struct session *s, unsigned char cmd, unsigned char state, unsigned char replyLen) {
+  s->state = state;
+  s->rxLen = 0;
+  s->rxWant = replyLen;
+  s->deadline = monoSeconds() + cfg.timeout;
+  s->cmdSentAt = wallSeconds();
+  sessSend(s, &cmd, 1);
+}
+
+// sync file of a time set, named by the time and phase sent. Devices set in the
+// same tick share it, and then also share the sample
+static void syncPath(char *path, size_t size, uint32_t seconds, uint16_t phase) {
+  snprintf(path, size, "%s/%lu.%u.sync", cfg.syncDir, (unsigned long)seconds, phase);
+}
+
+// fit the drift since the time the device reports it was last set to
+static void sessFitDrift(struct session *s) {
+  char path[PATH_MAX];
+  struct clockSample set;
+
+  if (!cfg.syncDir || s->lastSetSeconds == 0) {
+    return;
+  }
+  syncPath(path, sizeof(path), s->lastSetSeconds, s->lastSetPhase);
+  if (driftLoad(path, &set) == 0 && driftFitSamples(&s->fit, &set, &s->clockRead) == 0) {
+    s->haveFit = true;
+  }
+}
+
+// UART wire time of a request and of a ping reply
+static double requestWire(const struct session *s) {
+  return byteSeconds(s->baud);
+}
+
+static double pingReplyWire(const struct session *s) {
+  return PING_BYTES * byteSeconds(s->baud);
+}
+
+// ping until enough round trips are measured, then set the time
+static void sessSyncStep(struct session *s) {
+  tcflush(s->fd, TCIFLUSH);         /* drop what is left of a timed out ping */
+  if (s->ticksPerSec && s->pings < PING_COUNT) {
+    s->pings++;
+    sessCommand(s, CMD_PING, SESS_PING, PING_BYTES);
+  } else if (s->havePing) {
+    sessCommand(s, CMD_QUIT_PHASED, SESS_QUIT, 1);
+  } else {
+    sessCommand(s, CMD_QUIT, SESS_QUIT, 1);
+  }
+}
+
+// the 't' reply has arrived, rxLen tells whether it holds the time last set
+static void sessClockReply(struct session *s) {
+  s->ticksPerSec = get16le(s->rxBuf + 6);
+  s->clockUnset = (get32le(s->rxBuf) == 0);
+  s->clockRead.device = deviceClockValue(get32le(s->rxBuf), get16le(s->rxBuf + 4), s->ticksPerSec);
+  s->clockRead.host = s->cmdSentAt + byteSeconds(s->baud);   /* device reads its clock when 't' arrives */
+  if (s->rxLen == CLOCK_BYTES) {
+    s->lastSetSeconds = get32le(s->rxBuf + 8);
+    s->lastSetPhase = get16le(s->rxBuf + 12);
+  }
+  sessFitDrift(s);
+  sessCommand(s, CMD_GET_CONFIG, SESS_CONFIG, CONFIG_BYTES);
+}
+
+// (re)start the download from the first record, of the log or of the time range
+static void sessStartDownload(struct session *s) {
+  tcflush(s->fd, TCIFLUSH);
+  s->nextRecord = 0;
+  if (cfg.useRange) {
+    unsigned char range[2 * TIMESTAMP_BYTES];
+    put32le(range, cfg.rangeFirst);
+    put32le(range + TIMESTAMP_BYTES, cfg.rangeLast);
+    sessCommand(s, CMD_RANGE, SESS_COUNT, COUNT_BYTES);
+    if (s->state != SESS_FAILED) {
+      sessSend(s, range, sizeof(range));
+    }
+  } else {
+    sessCommand(s, CMD_DOWNLOAD, SESS_COUNT, COUNT_BYTES);
+  }
+}
+
+// raise the baud rate for the download if asked to
+static void sessStartTransfer(struct session *s) {
+  unsigned char code = BAUD_CODE_115200;
+
+  if (!cfg.fastBaud || s->baud == NAMASTE_FAST_BAUD) {
+    sessStartDownload(s);
+    return;
+  }
+  sessCommand(s, CMD_BAUD, SESS_BAUD, 1);
+  if (s->state != SESS_FAILED) {
+    sessSend(s, &code, 1);
+  }
+}
+
+static void sessTimeout(struct session *s) {
+  switch (s->state) {
+  case SESS_DOCKWAIT:
+    tcflush(s->fd, TCIFLUSH);
+    sessCommand(s, CMD_CLOCK, SESS_CLOCK, CLOCK_BYTES);
+    break;
+  case SESS_CLOCK:
+    if (s->rxLen == CLOCK_BYTES_OLD) {
+      sessClockReply(s);            /* firmware without the time last set, no drift correction */
+    } else {
+      sessCommand(s, CMD_GET_CONFIG, SESS_CONFIG, CONFIG_BYTES);  /* firmware without 't', no drift correction */
+    }
+    break;
+  case SESS_CONFIG:
+    sessStartTransfer(s);           /* firmware without 'g' only stores edges */
+    break;
+  case SESS_BAUD:
+    sessStartDownload(s);           /* firmware without 'b' stays at the old rate */
+    break;
+  case SESS_COUNT:
+  case SESS_RECORD:
+    /* the device index only rewinds on 'd' or 'f', so a lost reply restarts the download */
+    if (++s->retries > cfg.maxRetries) {
+      sessFail(s, "download timed out");
+    } else {
+      sessStartDownload(s);
+    }
+    break;
+  case SESS_RESET:
+    sessFail(s, "no ACK for reset");
+    break;
+  case SESS_PING:
+    sessSyncStep(s);                /* a lost ping is just one sample less */
+    break;
+  case SESS_QUIT:
+    sessFail(s, "no ACK for time set");
+    break;
+  }
+}
+
+// the download is complete: store the records before anything can erase them on the
+// device, so a later failure to set the time loses nothing
+static void sessAfterDownload(struct session *s) {
+  storeRecords(cfg.out, s);
+  if (cfg.doReset) {
+    sessCommand(s, CMD_RESET, SESS_RESET, 1);
+  } else if (cfg.doQuit) {
+    sessSyncStep(s);
+  } else {
+    s->state = SESS_DONE;
+    s->endTime = monoSeconds();
+  }
+}
+
+// a complete reply for the current state has arrived
+static void sessReply(struct session *s) {
+  switch (s->state) {
+  case SESS_CLOCK:
+    sessClockReply(s);
+    break;
+  case SESS_CONFIG:
+    if (s->rxBuf[0] == CONFIG_VERSION) {
+      s->senseSeconds = s->rxBuf[1];
+      s->storageMode = s->rxBuf[6];
+      s->bucketHours = s->rxBuf[7];
+      s->channels = s->rxBuf[8];
+    }
+    sessStartTransfer(s);
+    break;
+  case SESS_BAUD:
+    if (s->rxBuf[0] == ACK_VALUE) {
+      tcdrain(s->fd);
+      if (setRawMode(s->fd, NAMASTE_FAST_BAUD) < 0) {
+        sessFail(s, "cannot set the fast baud rate");
+        break;
+      }
+      s->baud = NAMASTE_FAST_BAUD;
+    }
+    sessStartDownload(s);
+    break;
+  case SESS_COUNT:
+    s->numRecords = get16le(s->rxBuf);
+    free(s->records);
+    s->records = malloc((s->numRecords ? s->numRecords : 1) * sizeof(*s->records));
+    if (!s->records) {
+      sessFail(s, "out of memory");
+    } else if (s->numRecords == 0) {
+      sessAfterDownload(s);
+    } else {
+      sessCommand(s, CMD_NEXT, SESS_RECORD, TIMESTAMP_BYTES);
+    }
+    break;
+  case SESS_RECORD:
+    s->records[s->nextRecord++] = get32le(s->rxBuf);
+    if (s->nextRecord < s->numRecords) {
+      sessCommand(s, CMD_NEXT, SESS_RECORD, TIMESTAMP_BYTES);
+    } else {
+      sessAfterDownload(s);
+    }
+    break;
+  case SESS_RESET:
+    if (s->rxBuf[0] != ACK_VALUE) {
+      sessFail(s, "bad ACK for reset");
+    } else if (cfg.doQuit) {
+      sessSyncStep(s);
+    } else {
+      s->state = SESS_DONE;
+      s->endTime = monoSeconds();
+    }
+    break;
+  case SESS_PING:
+    {
+      struct pingSample p;
+      uint32_t seconds = get32le(s->rxBuf);
+      uint16_t rxPhase = get16le(s->rxBuf + 4);
+      uint16_t txPhase = get16le(s->rxBuf + 6);
+
+      if (seconds == 0) {
+        s->clockUnset = true;
+      }
+      p.hostSend = s->cmdSentAt;
+      p.hostRecv = wallSeconds();
+      p.deviceRecv = deviceClockValue(seconds, rxPhase, s->ticksPerSec);
+      p.deviceSend = deviceClockValue(seconds + (txPhase < rxPhase), txPhase, s->ticksPerSec);
+      if (!s->havePing || pingLatency(&p, requestWire(s), pingReplyWire(s)) <
+                          pingLatency(&s->ping, requestWire(s), pingReplyWire(s))) {
+        s->ping = p;
+        s->havePing = true;
+      }
+      sessSyncStep(s);
+    }
+    break;
+  case SESS_QUIT:
+    if (s->rxBuf[0] != ACK_VALUE) {
+      sessFail(s, "bad ACK for time set");
+    } else if (s->havePing) {
+      /* the time is for the instant 'Q' reached the device */
+      unsigned char ts[PHASED_TIME_BYTES];
+      double arrival = s->cmdSentAt + requestWire(s) + pingLatency(&s->ping, requestWire(s), pingReplyWire(s));
+      uint32_t seconds = (uint32_t)arrival;
+      uint16_t phase = (uint16_t)((arrival - seconds) * s->ticksPerSec);
+      put32le(ts, seconds);
+      put16le(ts + TIMESTAMP_BYTES, phase);
+      if (sessSend(s, ts, sizeof(ts))) {
+        s->setSeconds = seconds;
+        s->setPhase = phase;
+        s->clockSet.device = deviceClockValue(seconds, phase, s->ticksPerSec);
+        s->clockSet.host = arrival;
+        s->timeSet = true;
+        tcdrain(s->fd);
+        s->state = SESS_DONE;
+        s->endTime = monoSeconds();
+      }
+    } else {
+      unsigned char ts[TIMESTAMP_BYTES];
+      double now = wallSeconds();
+      put32le(ts, (uint32_t)now);
+      if (sessSend(s, ts, sizeof(ts))) {
+        /* the device applies the time when the last byte arrives */
+        s->setSeconds = (uint32_t)now;
+        s->setPhase = 0;
+        s->clockSet.device = (uint32_t)now;
+        s->clockSet.host = now + TIMESTAMP_BYTES * byteSeconds(s->baud);
+        s->timeSet = true;
+        tcdrain(s->fd);
+        s->state = SESS_DONE;
+        s->endTime = monoSeconds();
+      }
+    }
+    break;
+  }
+}
+
+static void sessReadable(struct session *s) {
+  unsigned char buf[64];
+  ssize_t n;
+
+  while ((n = read(s->fd, buf, sizeof(buf))) > 0) {
+    ssize_t i;
+    s->bytesIn += (unsigned long)n;
+    for (i = 0; i < n; i++) {
+      if (s->state == SESS_DONE || s->state == SESS_FAILED || s->rxLen >= s->rxWant) {
+        continue;                   /* stray byte, ignore */
+      }
+      s->rxBuf[s->rxLen++] = buf[i];
+      if (s->rxLen == s->rxWant) {
+        sessReply(s);
+      }
+    }
+  }
+  if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {   /* raw ttys read 0 when empty */
+    sessFail(s, "port closed");
+  }
+}
+
+static bool sessActive(const struct session *s) {
+  return s->state != SESS_DONE && s->state != SESS_FAILED;
+}
+
+/* *** output *** */
+
+// append one device's occupancy or count buckets to the shared store
+static void storeBuckets(FILE *out, const struct session *s) {
+  uint32_t base = 0;
+  unsigned short i;
+  for (i = 0; i < s->numRecords; i++) {
+    uint32_t rec = s->records[i];
+    uint32_t ts;
+    if (isBaseRecord(rec)) {
+      base = recordTime(rec);
+      continue;
+    }
+    ts = base + (uint32_t)bucketOffset(rec) * s->bucketHours * 3600;
+    fprintf(out, "%s,%u,%c,%lu,%.0f,%lu\n", s->port, i, s->storageMode == STORE_COUNTS ? 'P' : 'O',
+            (unsigned long)ts, s->haveFit ? driftRetime(&s->fit, ts) : ts,
+            (unsigned long)bucketCount(rec) * (s->storageMode == STORE_COUNTS ? 1 : s->senseSeconds));
+  }
+  fflush(out);
+}
+
+// append one device's records to the shared store, with drift corrected timestamps
+static void storeRecords(FILE *out, const struct session *s) {
+  unsigned short i;
+  if (s->storageMode != STORE_EDGES) {
+    storeBuckets(out, s);
+    return;
+  }
+  for (i = 0; i < s->numRecords; i++) {
+    uint32_t ts = recordTime(s->records[i]);
+    double corrected;
+    if (s->channels > 1) {
+      ts = channelRecordTime(s->records[i], s->ticksPerSec ? (uint32_t)s->clockRead.device : (uint32_t)wallSeconds());
+      fprintf(out, "%s#%u,", s->port, recordChannel(s->records[i]));
+    } else {
+      fprintf(out, "%s,", s->port);
+    }
+    corrected = s->haveFit ? driftRetime(&s->fit, ts) : ts;
+    fprintf(out, "%u,%u,%lu,%.0f\n", i, recordState(s->records[i]), (unsigned long)ts, corrected);
+  }
+  fflush(out);
+}
+
+static void saveSync(const struct session *s) {
+  char path[PATH_MAX];
+  if (cfg.syncDir && s->timeSet) {
+    syncPath(path, sizeof(path), s->setSeconds, s->setPhase);
+    if (driftSave(path, &s->clockSet) < 0) {
+      perror(path);
+    }
+  }
+}
+
+static void report(const struct session *sess, int count, double elapsed) {
+  int i;
+  fprintf(stderr, "%-24s %-8s %7s %9s %10s %10s %10s %10s\n", "port", "status", "records", "seconds",
+          "bytes/s", "records/s", "drift ppm", "offset ms");
+  for (i = 0; i < count; i++) {
+    const struct session *s = &sess[i];
+    double dt = s->endTime - s->startTime;
+    char ppm[16] = "-";
+    char offset[16] = "-";
+    if (s->haveFit) {
+      snprintf(ppm, sizeof(ppm), "%+.0f", driftPpm(&s->fit));
+    }
+    if (s->havePing && !s->clockUnset) {    /* device minus host before the time was set */
+      struct clockSample c;
+      pingClockSample(&c, &s->ping, requestWire(s), pingReplyWire(s));
+      snprintf(offset, sizeof(offset), "%+.1f", (c.device - c.host) * 1000);
+    }
+    fprintf(stderr, "%-24s %-8s %7u %9.2f %10.0f %10.1f %10s %10s%s%s\n", s->port,
+            (s->state == SESS_DONE) ? "ok" : "FAILED", s->numRecords, dt,
+            dt > 0 ? (s->bytesIn + s->bytesOut) / dt : 0.0,
+            dt > 0 ? s->nextRecord / dt : 0.0, ppm, offset,
+            s->error ? "  " : "", s->error ? s->error : "");
+  }
+  fprintf(stderr, "total %.2f s for %d devices\n", elapsed, count);
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [options] PORT...\n"
+          "  -o FILE   shared output store (CSV: port,index,state,timestamp,corrected[,occupied]; default stdout)\n"
+          "  -S DIR    keep the clock sample of each time set in DIR and correct drift\n"
+          "  -r        erase each device after a complete download\n"
+          "  -n        do not set the time (leaves devices in UART mode)\n"
+          "  -f A,B    fetch only the records from UNIX time A to B (edge storage only, not with -r)\n"
+          "  -t MS     reply timeout (default %d)\n"
+          "  -w MS     wait after opening a port before the first command (default %d)\n"
+          "  -b BAUD   baud rate (default %d)\n"
+          "  -F        download at %d baud, switched with 'b' (not with -n)\n",
+          prog, DEFAULT_TIMEOUT_MS, DOCK_STABLE_MS + 100, NAMASTE_BAUD, NAMASTE_FAST_BAUD);
+}
+
+int main(int argc, char *argv[]) {
+  struct session *sess;
+  FILE *out = stdout;
+  double start;
+  int epfd, count, active, i, opt;
+  int failed = 0;
+
+  while ((opt = getopt(argc, argv, "o:S:rnf:t:w:b:Fh")) != -1) {
+    switch (opt) {
+    case 'o':
+      out = fopen(optarg, "a");
+      if (!out) {
+        perror(optarg);
+        return 1;
+      }
+      break;
+    case 'S': cfg.syncDir = optarg; break;
+    case 'r': cfg.doReset = true; break;
+    case 'n': cfg.doQuit = false; break;
+    case 'f':
+      {
+        unsigned long first, last;
+        if (sscanf(optarg, "%lu,%lu", &first, &last) != 2 || first > last || last > TIMESTAMP_MASK) {
+          usage(argv[0]);
+          return 2;
+        }
+        cfg.useRange = true;
+        cfg.rangeFirst = (uint32_t)first;
+        cfg.rangeLast = (uint32_t)last;
+      }
+      break;
+    case 't': cfg.timeout = atof(optarg) / 1000.0; break;
+    case 'w': cfg.dockWait = atof(optarg) / 1000.0; break;
+    case 'b': cfg.baud = strtoul(optarg, NULL, 0); break;
+    case 'F': cfg.fastBaud = true; break;
+    default: usage(argv[0]); return 2;
+    }
+  }
+  cfg.out = out;
+  count = argc - optind;
+  if (count <= 0 || (cfg.useRange && cfg.doReset) || (cfg.fastBaud && !cfg.doQuit)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  sess = calloc((size_t)count, sizeof(*sess));
+  epfd = epoll_create1(0);
+  if (!sess || epfd < 0) {
+    perror("init");
+    return 1;
+  }
+
+  start = monoSeconds();
+  for (i = 0; i < count; i++) {
+    struct session *s = &sess[i];
+    struct epoll_event ev;
+
+    s->port = argv[optind + i];
+    s->baud = cfg.baud;
+    s->startTime = start;
+    s->state = SESS_DOCKWAIT;
+    s->deadline = start + cfg.dockWait;
+    s->fd = open(s->port, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (s->fd < 0 || setRawMode(s->fd, cfg.baud) < 0) {
+      sessFail(s, strerror(errno));
+      continue;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = s;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, s->fd, &ev) < 0) {
+      sessFail(s, strerror(errno));
+    }
+  }
+
+  do {
+    struct epoll_event events[MAX_EVENTS];
+    double now = monoSeconds();
+    double next = -1;
+    int n, timeoutMs;
+
+    active = 0;
+    for (i = 0; i < count; i++) {
+      if (sessActive(&sess[i])) {
+        active++;
+        if (next < 0 || sess[i].deadline < next) {
+          next = sess[i].deadline;
+        }
+      }
+    }
+    if (!active) {
+      break;
+    }
+    timeoutMs = (next <= now) ? 0 : (int)((next - now) * 1000.0) + 1;
+
+    n = epoll_wait(epfd, events, MAX_EVENTS, timeoutMs);
+    if (n < 0 && errno != EINTR) {
+      perror("epoll_wait");
+      break;
+    }
+    for (i = 0; i < n; i++) {
+      struct session *s = events[i].data.ptr;
+      if (s->state == SESS_DOCKWAIT) {
+        tcflush(s->fd, TCIFLUSH);   /* nothing is expected before the first command */
+      } else {
+        sessReadable(s);
+      }
+    }
+
+    now = monoSeconds();
+    for (i = 0; i < count; i++) {
+      struct session *s = &sess[i];
+      if (sessActive(s) && now >= s->deadline) {
+        sessTimeout(s);
+      }
+      if (!sessActive(s) && s->fd >= 0) {
+        if (s->state == SESS_DONE) {
+          saveSync(s);
+        }
+        epoll_ctl(epfd, EPOLL_CTL_DEL, s->fd, NULL);
+        close(s->fd);
+        s->fd = -1;
+      }
+    }
+  } while (active);
+
+  for (i = 0; i < count; i++) {
+    if (sess[i].state != SESS_DONE) {
+      failed++;
+    }
+    if (sess[i].fd >= 0) {
+      close(sess[i].fd);
+    }
+    free(sess[i].records);
+  }
+  report(sess, count, monoSeconds() - start);
+  if (out != stdout) {
+    fclose(out);
+  }
+  free(sess);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,84 @@
+/*
+    namasteDrift.c
+    Clock drift estimation and timestamp correction for Namaste devices
+*/
+
+#include "namasteDrift.h"
+
+#include <math.h>
+#include <stdio.h>
+
+// device clock reading from the 't' reply
+double deviceClockValue(uint32_t seconds, uint16_t phase, uint16_t ticksPerSec) {
+  return ticksPerSec ? seconds + (double)phase / ticksPerSec : (double)seconds;
+}
+
+// fit the device clock rate between the sample taken when the time was set and
+// the sample read back at the next dock, returns -1 if the samples are unusable
+int driftFitSamples(struct driftFit *fit, const struct clockSample *set, const struct clockSample *read) {
+  double hostSpan = read->host - set->host;
+  double deviceSpan = read->device - set->device;
+
+  if (set->device <= 0 || read->device <= 0 || hostSpan <= 0) {
+    return -1;                      /* device time was never set or samples are out of order */
+  }
+  fit->hostStart = set->host;
+  fit->deviceStart = set->device;
+  fit->deviceEnd = read->device;
+  fit->rate = deviceSpan / hostSpan;
+  if (fabs(fit->rate - 1.0) > DRIFT_MAX_ERROR) {
+    return -1;
+  }
+  return 0;
+}
+
+// map a device timestamp from the fitted interval to host time; timestamps
+// outside the interval belong to another sync and are returned unchanged
+double driftRetime(const struct driftFit *fit, double deviceTime) {
+  if (deviceTime < fit->deviceStart || deviceTime > fit->deviceEnd) {
+    return deviceTime;
+  }
+  return fit->hostStart + (deviceTime - fit->deviceStart) / fit->rate;
+}
+
+double driftPpm(const struct driftFit *fit) {
+  return (fit->rate - 1.0) * 1e6;
+}
+
+// one-way latency of a ping on top of the wire time, half of what the round trip
+// does not account for
+double pingLatency(const struct pingSample *p, double requestWire, double replyWire) {
+  double rtt = (p->hostRecv - p->hostSend) - (p->deviceSend - p->deviceRecv);
+  double latency = (rtt - requestWire - replyWire) / 2;
+  return (latency > 0) ? latency : 0;
+}
+
+// host time at which the device read deviceRecv: the ping was fully received
+// one latency and one request wire time after it was sent
+void pingClockSample(struct clockSample *sample, const struct pingSample *p, double requestWire, double replyWire) {
+  sample->host = p->hostSend + requestWire + pingLatency(p, requestWire, replyWire);
+  sample->device = p->deviceRecv;
+}
+
+// load the sample saved when the device time was last set
+int driftLoad(const char *path, struct clockSample *set) {
+  FILE *fp = fopen(path, "r");
+  int ok;
+
+  if (!fp) {
+    return -1;
+  }
+  ok = (fscanf(fp, "%lf %lf", &set->host, &set->device) == 2);
+  fclose(fp);
+  return ok ? 0 : -1;
+}
+
+int driftSave(const char *path, const struct clockSample *set) {
+  FILE *fp = fopen(path, "w");
+
+  if (!fp) {
+    return -1;
+  }
+  fprintf(fp, "%.6f %.6f\n", set->host, set->device);
+  return fclose(fp);
+}
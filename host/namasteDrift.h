@@ -0,0 +1,55 @@
+/*
+    namasteDrift.h
+    Clock drift estimation and timestamp correction for Namaste devices
+
+    The device clock is set with 'q' at one dock and read back with 't' at the
+    next. Those two samples give the rate of the device clock against the host
+    clock over the interval, and every record logged in between is re-timed
+    linearly from it.
+
+    Clock samples are taken NTP style with 'p': the host notes when it sent the
+    ping and when the reply arrived, the device reports its clock when the ping
+    arrived and when it replied. Whatever is left of the round trip after the
+    UART wire time and the device turnaround is split evenly between the two
+    directions, and the exchange with the smallest round trip is trusted most.
+*/
+
+#ifndef NAMASTE_DRIFT_H
+#define NAMASTE_DRIFT_H
+
+#include <stdint.h>
+
+/* the same instant seen by both clocks, in seconds from epoch */
+struct clockSample {
+  double host;
+  double device;
+};
+
+/* linear map from device time to host time over one sync interval */
+struct driftFit {
+  double hostStart;
+  double deviceStart;
+  double deviceEnd;
+  double rate;                      /* device seconds per host second */
+};
+
+/* one 'p' exchange, host times from the host clock and device times from the device clock */
+struct pingSample {
+  double hostSend;
+  double deviceRecv;
+  double deviceSend;
+  double hostRecv;
+};
+
+#define DRIFT_MAX_ERROR 0.5         /* reject fits more than 50% off, the VLO is bad but not that bad */
+
+double deviceClockValue(uint32_t seconds, uint16_t phase, uint16_t ticksPerSec);
+int driftFitSamples(struct driftFit *fit, const struct clockSample *set, const struct clockSample *read);
+double driftRetime(const struct driftFit *fit, double deviceTime);
+double driftPpm(const struct driftFit *fit);
+double pingLatency(const struct pingSample *p, double requestWire, double replyWire);
+void pingClockSample(struct clockSample *sample, const struct pingSample *p, double requestWire, double replyWire);
+int driftLoad(const char *path, struct clockSample *set);
+int driftSave(const char *path, const struct clockSample *set);
+
+#endif
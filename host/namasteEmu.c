@@ -0,0 +1,1227 @@
+/*
+    namasteEmu.c
+    Pseudo-terminal emulator of a docked namasteTrunk board
+
+    Exposes a PTY that answers the same commands, in the same byte order and
+    with the same ACK semantics as USCI0RX_ISR in namasteTrunk/main.c, so host
+    tools can be developed and load tested without boards. The wire can be
+    paced to a baud rate and impaired with latency, byte drops and corruption.
+
+    Opening the slave PTY counts as docking the board (PCCOMM high) and
+    closing it as undocking, so every client connection is one dock session.
+
+    The device clock runs between docks and can be given a drift in ppm, so
+    the clock read back with 't' can be used to test drift correction. 'p'
+    and 'Q' read and set it to the timer tick, which together with -L tests
+    the round trip compensated time set. The sensing parameters read and
+    written with 'g' and 'c' set the clock step of each sense tick, the
+    event filter and the storage mode. The emulated board has a single
+    sensor channel; 'a' gives a noisy ADC reading of the emulated mat, and
+    the sense mode is kept but does not change how the mat is sampled. 'b'
+    switches a paced wire to 115200 baud until the time is set or the board
+    is undocked.
+
+    'B' resets the board into the UART bootloader (BOOT/uartBoot), which is
+    emulated with a flash array, erase and write times and the baud switch,
+    so namasteFlash can be tested too. Starting the application again acts
+    like a reset of namasteTrunk.
+
+    Build:  gcc -Wall -O2 -o namasteEmu namasteEmu.c namasteProto.c -lm
+*/
+
+#define _GNU_SOURCE
+#include "namasteProto.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* mode values (same meaning as the firmware) */
+#define UARTWAITMODE    1       /* cable plugged in, but waiting to start communicating with PC */
+#define UARTMODE        2       /* communicating with PC */
+#define UARTDONEMODE    3       /* done communicating with PC, but cable is still plugged in */
+#define SENSEMODE       4       /* undocked */
+#define STREAMMODE      5       /* cable plugged in, pushing events to PC as they happen */
+#define BOOTMODE        6       /* resident UART bootloader */
+
+/* emulator defaults */
+#define SENSE_PERIOD_SEC    15      /* synthetic events are spaced in whole sense ticks */
+#define SYNTH_MAX_GAP_TICKS 240     /* up to 1 hour between synthetic events */
+#define UNDOCKED_POLL_MS    50
+#define DEFAULT_EVENT_PROB  0.2     /* chance of a mat state change per sense tick while streaming */
+#define TIMER_TICKS_PER_SEC 1365    /* ACLK/8 ticks per second, unit of the 't' phase */
+#define ADC_OPEN            900     /* 'a' readings of an open and a closed mat, give or take ADC_NOISE */
+#define ADC_CLOSED          120
+#define ADC_NOISE           20
+#define FLASH_SIZE          0x10000 /* whole address space, only the main flash is saved */
+#define SEGMENT_ERASE_SEC   0.015   /* segment erase with the flash timing generator at ~350 kHz */
+#define BLOCK_BYTE_SEC      60e-6   /* per byte of a block write */
+
+/* one byte in flight on the emulated wire */
+struct wireByte {
+  double when;                      /* time the byte reaches the other side */
+  unsigned char value;
+};
+
+struct wireQueue {
+  struct wireByte *bytes;
+  size_t head;
+  size_t count;
+  size_t cap;
+};
+
+/* state mirrored from namasteTrunk/main.c */
+struct device {
+  unsigned char mode;
+  uint32_t curTimestamp;
+  uint32_t setTimestamp;            /* time last received, sent back with 't' */
+  uint16_t setPhase;
+  uint32_t *records;
+  size_t numRecords;
+  bool recvingTimestamp;
+  unsigned short sendingIndex;      /* static in USCI0RX_ISR */
+  uint32_t rcvTimestamp;            /* static in USCI0RX_ISR */
+  uint16_t rcvPhase;                /* static in USCI0RX_ISR */
+  double rcvStartClock;             /* device clock when 'Q' arrived (rcvStartTicks) */
+  unsigned char rcvCommand;         /* static in USCI0RX_ISR */
+  unsigned char rcvLength;          /* static in USCI0RX_ISR */
+  unsigned char prevMatState;
+  unsigned char matState;           /* emulated sensor */
+  unsigned char runState;           /* event filter (filterSample() in the firmware) */
+  unsigned char runLength;
+  uint32_t runStart;
+  unsigned char confirmedState;
+  unsigned char pendingState;
+  uint32_t pendingTime;
+  unsigned char pendingAge;
+  unsigned short filteredEvents;
+  unsigned short summaryEvents;     /* log summary ('u') */
+  uint32_t firstTime;
+  uint32_t lastTime;
+  uint32_t occupiedSeconds;
+  unsigned short droppedRecords;
+  uint32_t closedSince;
+  uint32_t bucketStart;             /* occupancy histogram (countOccupancy() in the firmware) */
+  uint16_t bucketOccupied;
+  uint16_t presses;                 /* STORE_COUNTS: releases of the raw mat, as timer B counts them */
+  uint32_t baseBucket;
+  unsigned char config[CONFIG_BYTES];   /* sensing parameters ('g' layout) */
+  unsigned char rcvConfig[CONFIG_BYTES];
+  bool recvingConfig;
+  bool recvingRange;
+  bool recvingBaud;
+  uint32_t rcvRange[2];             /* static in USCI0RX_ISR */
+  unsigned short downloadBase;      /* first record of the 'd' or 'f' walk (readStart) */
+  unsigned short downloadCount;
+  size_t recordsCap;
+  double clockBase;                 /* device clock at clockSetAt, 0 while the time is not set */
+  double clockSetAt;
+};
+
+/* wire impairments */
+struct impair {
+  unsigned long baud;               /* 0 = unpaced */
+  double latency;                   /* one-way latency in seconds */
+  double dropProb;
+  double corruptProb;
+  double dockDelay;                 /* seconds between dock and UART mode */
+};
+
+struct stats {
+  unsigned long rxBytes;
+  unsigned long txBytes;
+  unsigned long dropped;
+  unsigned long corrupted;
+  unsigned long overruns;
+  unsigned long commands;
+};
+
+struct emu {
+  int master;
+  struct device dev;
+  struct impair imp;
+  struct stats st;
+  struct wireQueue rxq;             /* host -> device */
+  struct wireQueue txq;             /* device -> host */
+  double rxFree;                    /* time the emulated RX line is free */
+  double txFree;                    /* time the emulated TX line is free */
+  double busyUntil;                 /* device is inside the RX ISR until then */
+  double dockTime;
+  double nextSense;                 /* next sense tick while streaming */
+  double sensePeriod;               /* wall seconds per emulated sense tick */
+  double eventProb;
+  double driftPpm;                  /* device clock error */
+  unsigned char *flash;             /* flash contents seen by the bootloader */
+  const char *flashPath;
+  struct bootDecoder bootDec;
+  double bootDeadline;              /* bootloader starts the application if not synced by then */
+  bool bootSynced;
+  bool docked;
+  bool verbose;
+};
+
+static volatile sig_atomic_t quitting;
+
+static void onSignal(int sig) {
+  (void)sig;
+  quitting = 1;
+}
+
+/* *** wire queues *** */
+
+static void wirePush(struct wireQueue *q, double when, unsigned char value) {
+  if (q->count == q->cap) {
+    size_t newCap = q->cap ? q->cap * 2 : 256;
+    struct wireByte *grown = malloc(newCap * sizeof(*grown));
+    size_t i;
+    if (!grown) {
+      perror("malloc");
+      exit(1);
+    }
+    for (i = 0; i < q->count; i++) {
+      grown[i] = q->bytes[(q->head + i) % q->cap];
+    }
+    free(q->bytes);
+    q->bytes = grown;
+    q->head = 0;
+    q->cap = newCap;
+  }
+  q->bytes[(q->head + q->count) % q->cap].when = when;
+  q->bytes[(q->head + q->count) % q->cap].value = value;
+  q->count++;
+}
+
+static struct wireByte *wirePeek(struct wireQueue *q, size_t n) {
+  return (n < q->count) ? &q->bytes[(q->head + n) % q->cap] : NULL;
+}
+
+static void wirePop(struct wireQueue *q) {
+  q->head = (q->head + 1) % q->cap;
+  q->count--;
+}
+
+static void wireFlush(struct wireQueue *q) {
+  q->head = 0;
+  q->count = 0;
+}
+
+/* *** impairments *** */
+
+static double randUnit(void) {
+  return rand() / ((double)RAND_MAX + 1.0);
+}
+
+// apply drop/corruption to one byte, returns false if the byte is lost
+static bool impairByte(struct emu *emu, unsigned char *value) {
+  if (emu->imp.dropProb > 0 && randUnit() < emu->imp.dropProb) {
+    emu->st.dropped++;
+    return false;
+  }
+  if (emu->imp.corruptProb > 0 && randUnit() < emu->imp.corruptProb) {
+    *value ^= (unsigned char)(1 << (rand() % 8));
+    emu->st.corrupted++;
+  }
+  return true;
+}
+
+/* *** emulated firmware *** */
+
+// transmit a single char (queues it on the paced TX line)
+static void transmitChar(struct emu *emu, double now, unsigned char c) {
+  double start = (emu->txFree > now) ? emu->txFree : now;
+
+  emu->txFree = start + byteSeconds(emu->imp.baud);
+  /* transmitChar() returns once the byte is in UCA0TXBUF, i.e. once the previous byte is shifting out */
+  emu->busyUntil = start;
+  emu->st.txBytes++;
+  if (impairByte(emu, &c)) {
+    wirePush(&emu->txq, emu->txFree + emu->imp.latency, c);
+  }
+}
+
+// sends 16-bit value low-order byte first
+static void send16bit(struct emu *emu, double now, uint16_t val) {
+  unsigned char i;
+  for (i = 0; i < 2; i++) {
+    transmitChar(emu, now, (unsigned char)val);
+    val >>= 8;
+  }
+}
+
+// sends 32-bit value low-order byte first
+static void send32bit(struct emu *emu, double now, uint32_t val) {
+  unsigned char i;
+  for (i = 0; i < 4; i++) {
+    transmitChar(emu, now, (unsigned char)val);
+    val >>= 8;
+  }
+}
+
+// sends a framed message (sendFrame() in the firmware)
+static void sendFrame(struct emu *emu, double now, unsigned char type, const unsigned char *payload, unsigned char len) {
+  unsigned char buf[FRAME_OVERHEAD + FRAME_MAX_PAYLOAD];
+  size_t i, n;
+
+  n = frameEncode(buf, type, payload, len);
+  for (i = 0; i < n; i++) {
+    transmitChar(emu, now, buf[i]);
+  }
+}
+
+// device clock in seconds, including drift
+static double deviceClock(const struct emu *emu, double now) {
+  if (emu->dev.clockBase == 0) {
+    return 0;
+  }
+  return emu->dev.clockBase + (now - emu->dev.clockSetAt) * (1.0 + emu->driftPpm * 1e-6);
+}
+
+static void setDeviceClock(struct emu *emu, double now, double seconds) {
+  emu->dev.curTimestamp = (uint32_t)seconds;
+  emu->dev.clockBase = seconds;
+  emu->dev.clockSetAt = now;
+}
+
+static void storeRecord(struct device *dev, uint32_t record) {
+  if (dev->numRecords < MAX_RECORDS) {
+    if (dev->numRecords == dev->recordsCap) {
+      uint32_t *grown;
+      dev->recordsCap = dev->recordsCap ? dev->recordsCap * 2 : 256;
+      grown = realloc(dev->records, dev->recordsCap * sizeof(*grown));
+      if (!grown) {
+        perror("realloc");
+        exit(1);
+      }
+      dev->records = grown;
+    }
+    dev->records[dev->numRecords++] = record;
+  } else if (dev->droppedRecords != 0xFFFF) {
+    dev->droppedRecords++;
+  }
+}
+
+// endClosedRun() in the firmware
+static void endClosedRun(struct device *dev, uint32_t timestamp) {
+  if (dev->closedSince != 0 && timestamp > dev->closedSince) {
+    dev->occupiedSeconds += timestamp - dev->closedSince;
+  }
+  dev->closedSince = 0;
+}
+
+static void clearSummary(struct device *dev) {
+  dev->summaryEvents = 0;
+  dev->firstTime = 0;
+  dev->lastTime = 0;
+  dev->occupiedSeconds = 0;
+  dev->droppedRecords = 0;
+  dev->filteredEvents = 0;
+  dev->closedSince = 0;
+}
+
+static void recordEvent(struct emu *emu, double now, unsigned char matState, uint32_t timestamp) {
+  struct device *dev = &emu->dev;
+  uint32_t record = makeRecord(matState, timestamp);
+
+  if (dev->mode == STREAMMODE) {
+    unsigned char payload[TIMESTAMP_BYTES];
+    put32le(payload, record);
+    sendFrame(emu, now, FRAME_EVENT, payload, sizeof(payload));
+  }
+  if (dev->config[6] == STORE_EDGES) {
+    storeRecord(dev, record);
+  }
+  dev->prevMatState = matState;
+
+  if (dev->summaryEvents != 0xFFFF) {
+    dev->summaryEvents++;
+  }
+  if (dev->firstTime == 0) {
+    dev->firstTime = timestamp;
+  }
+  dev->lastTime = timestamp;
+  endClosedRun(dev, timestamp);
+  if (matState == MAT_CLOSED) {
+    dev->closedSince = timestamp;
+  }
+}
+
+// mirror of commitBucket()
+static void commitBucket(struct device *dev) {
+  uint32_t bucketSeconds = dev->config[7] * 3600u;
+  uint32_t offset;
+
+  if (dev->config[6] == STORE_COUNTS && dev->bucketStart != 0) {
+    dev->bucketOccupied = dev->presses;
+    dev->presses = 0;
+  }
+  if (dev->bucketOccupied != 0) {
+    offset = (dev->bucketStart - dev->baseBucket) / bucketSeconds;
+    if (dev->baseBucket == 0 || dev->bucketStart < dev->baseBucket || offset > 0x7FFF) {
+      dev->baseBucket = dev->bucketStart;
+      offset = 0;
+      storeRecord(dev, BASE_RECORD_FLAG | (dev->bucketStart & TIMESTAMP_MASK));
+    }
+    storeRecord(dev, (offset << 16) | dev->bucketOccupied);
+  }
+  dev->bucketOccupied = 0;
+}
+
+// mirror of countOccupancy()
+static void countOccupancy(struct device *dev) {
+  uint32_t bucketSeconds = dev->config[7] * 3600u;
+  uint32_t start;
+
+  if (dev->config[6] == STORE_EDGES || dev->curTimestamp == 0) {
+    return;
+  }
+  start = dev->curTimestamp - dev->curTimestamp % bucketSeconds;
+  if (start != dev->bucketStart) {
+    commitBucket(dev);
+    dev->bucketStart = start;
+  }
+  if (dev->config[6] == STORE_OCCUPANCY && dev->confirmedState == MAT_CLOSED) {
+    dev->bucketOccupied++;
+  }
+}
+
+static void resetEventFilter(struct device *dev) {
+  dev->prevMatState = 0xFF;
+  dev->runState = 0xFF;
+  dev->runLength = 0;
+  dev->confirmedState = 0xFF;
+  dev->pendingState = 0xFF;
+}
+
+// mirror of filterSample(): hysteresis, then a minimum dwell that drops short pairs
+static void filterSample(struct emu *emu, double now, unsigned char matState) {
+  struct device *dev = &emu->dev;
+
+  if (matState != dev->runState) {
+    dev->runState = matState;
+    dev->runLength = 0;
+    dev->runStart = dev->curTimestamp;
+  }
+  if (dev->runLength != 0xFF) {
+    dev->runLength++;
+  }
+  if (dev->runState != dev->confirmedState && dev->runLength >= dev->config[4]) {
+    dev->confirmedState = dev->runState;
+    if (dev->pendingState != 0xFF) {
+      dev->filteredEvents++;
+    }
+    if (dev->confirmedState == dev->prevMatState) {
+      dev->pendingState = 0xFF;
+      dev->filteredEvents++;
+    } else {
+      dev->pendingState = dev->confirmedState;
+      dev->pendingTime = dev->runStart;
+      dev->pendingAge = 0;
+    }
+  }
+  if (dev->pendingState != 0xFF) {
+    if (dev->pendingAge >= dev->config[5]) {
+      recordEvent(emu, now, dev->pendingState, dev->pendingTime);
+      dev->pendingState = 0xFF;
+    } else {
+      dev->pendingAge++;
+    }
+  }
+}
+
+// one SENSEMODE/STREAMMODE timer tick with a random mat
+static void senseTick(struct emu *emu, double now) {
+  struct device *dev = &emu->dev;
+
+  if (dev->curTimestamp != 0) {
+    setDeviceClock(emu, now, dev->curTimestamp + dev->config[1]);
+  }
+  if (dev->matState > MAT_OPEN || randUnit() < emu->eventProb) {
+    dev->matState = (dev->matState == MAT_OPEN) ? MAT_CLOSED : MAT_OPEN;
+    if (dev->matState == MAT_OPEN && dev->presses != BUCKET_COUNT_MAX) {
+      dev->presses++;
+    }
+  }
+  if (dev->config[6] == STORE_COUNTS) {
+    countOccupancy(dev);              /* the firmware does not sample the mat while counting */
+    if (dev->mode == STREAMMODE) {
+      unsigned char payload[TIMESTAMP_BYTES];
+      put32le(payload, dev->curTimestamp);
+      sendFrame(emu, now, FRAME_HEARTBEAT, payload, sizeof(payload));
+    }
+    return;
+  }
+  filterSample(emu, now, dev->matState);
+  countOccupancy(dev);
+  if (dev->mode == STREAMMODE) {
+    unsigned char payload[TIMESTAMP_BYTES];
+    put32le(payload, dev->curTimestamp);
+    sendFrame(emu, now, FRAME_HEARTBEAT, payload, sizeof(payload));
+  }
+}
+
+static unsigned short getNumTimestamps(const struct device *dev) {
+  return (unsigned short)dev->numRecords;
+}
+
+static uint32_t getTimestamp(const struct device *dev, unsigned short timestampIndex) {
+  return (timestampIndex < dev->numRecords) ? dev->records[timestampIndex] : 0;
+}
+
+// findRange() in the firmware, a linear scan does the same here
+static unsigned short findRange(struct device *dev, uint32_t first, uint32_t last) {
+  unsigned short i;
+
+  dev->downloadBase = 0;
+  if (dev->config[6] != STORE_EDGES) {
+    return 0;
+  }
+  for (i = 0; i < getNumTimestamps(dev) && recordTime(dev->records[i]) < first; i++) {
+  }
+  dev->downloadBase = i;
+  for (; i < getNumTimestamps(dev) && recordTime(dev->records[i]) <= last; i++) {
+  }
+  return (unsigned short)(i - dev->downloadBase);
+}
+
+/* *** emulated bootloader (BOOT/uartBoot/main.c) *** */
+
+static bool loadFlash(struct emu *emu) {
+  FILE *fp = fopen(emu->flashPath, "rb");
+  size_t n;
+
+  if (!fp) {
+    return false;
+  }
+  n = fread(emu->flash + BOOT_APP_START, 1, FLASH_SIZE - BOOT_APP_START, fp);
+  fclose(fp);
+  return n > 0;
+}
+
+static void saveFlash(const struct emu *emu) {
+  FILE *fp;
+
+  if (!emu->flashPath) {
+    return;
+  }
+  fp = fopen(emu->flashPath, "wb");
+  if (!fp || fwrite(emu->flash + BOOT_APP_START, 1, FLASH_SIZE - BOOT_APP_START, fp) != FLASH_SIZE - BOOT_APP_START ||
+      fclose(fp) != 0) {
+    perror(emu->flashPath);
+  }
+}
+
+static bool appValid(const struct emu *emu) {
+  uint16_t reset = get16le(emu->flash + BOOT_APP_END - 2);
+  return reset != 0xFFFF && reset >= BOOT_APP_START && reset < BOOT_APP_END;
+}
+
+// reset into the bootloader with the cable plugged in
+static void enterBootloader(struct emu *emu, double now) {
+  emu->dev.mode = BOOTMODE;
+  emu->dev.recvingTimestamp = false;
+  emu->bootSynced = false;
+  emu->bootDeadline = now + BOOT_WAIT_MS / 1000.0;
+  bootFrameReset(&emu->bootDec);
+  if (emu->imp.baud) {
+    emu->imp.baud = NAMASTE_BAUD;
+  }
+  if (emu->verbose) {
+    fprintf(stderr, "emu: bootloader\n");
+  }
+}
+
+// jump to the application: namasteTrunk starts from scratch and finds the cable plugged in
+static void startApp(struct emu *emu, double now) {
+  saveFlash(emu);
+  emu->dev.mode = UARTWAITMODE;
+  emu->dev.recvingConfig = false;
+  emu->dev.recvingRange = false;
+  emu->dev.recvingBaud = false;
+  emu->dev.numRecords = 0;          /* clearTimestamps() */
+  clearSummary(&emu->dev);
+  emu->dev.bucketStart = 0;
+  emu->dev.bucketOccupied = 0;
+  emu->dev.baseBucket = 0;
+  emu->dev.curTimestamp = 0;
+  emu->dev.setTimestamp = 0;
+  emu->dev.setPhase = 0;
+  emu->dev.clockBase = 0;
+  emu->dockTime = now;
+  if (emu->imp.baud) {
+    emu->imp.baud = NAMASTE_BAUD;
+  }
+  if (emu->verbose) {
+    fprintf(stderr, "emu: application started\n");
+  }
+}
+
+static void bootReply(struct emu *emu, double now, unsigned char type, unsigned char status,
+                      const unsigned char *data, unsigned char len) {
+  unsigned char payload[BOOT_MAX_PAYLOAD];
+  unsigned char buf[BOOT_FRAME_OVERHEAD + BOOT_MAX_PAYLOAD];
+  size_t i, n;
+
+  payload[0] = status;
+  memcpy(payload + 1, data, len);
+  n = bootFrameEncode(buf, type, payload, (unsigned char)(len + 1));
+  for (i = 0; i < n; i++) {
+    transmitChar(emu, now, buf[i]);
+  }
+}
+
+static unsigned char bootErase(struct emu *emu, uint16_t addr) {
+  if (addr < BOOT_APP_START || addr >= BOOT_APP_END || addr % BOOT_SEGMENT_SIZE != 0) {
+    return BOOT_ERR_ADDRESS;
+  }
+  memset(emu->flash + addr, 0xFF, BOOT_SEGMENT_SIZE);
+  return BOOT_OK;
+}
+
+static unsigned char bootWrite(struct emu *emu, uint16_t addr, const unsigned char *data, unsigned char len) {
+  unsigned char i;
+
+  if (addr < BOOT_APP_START || addr >= BOOT_APP_END || addr + len > BOOT_APP_END ||
+      addr % BOOT_BLOCK_SIZE + len > BOOT_BLOCK_SIZE) {
+    return BOOT_ERR_ADDRESS;
+  }
+  for (i = 0; i < len; i++) {
+    emu->flash[addr + i] &= data[i];  /* programming only clears bits */
+    if (emu->flash[addr + i] != data[i]) {
+      return BOOT_ERR_VERIFY;
+    }
+  }
+  return BOOT_OK;
+}
+
+// one received byte in the bootloader's frame loop
+static void bootRx(struct emu *emu, double now, unsigned char c) {
+  struct bootDecoder *dec = &emu->bootDec;
+  unsigned char reply[6];
+  uint16_t addr;
+  int ret;
+
+  emu->busyUntil = now;
+  ret = bootFrameFeed(dec, c);
+  if (ret < 0) {
+    bootReply(emu, now, BOOT_BAD_FRAME, BOOT_ERR_FRAME, NULL, 0);
+    return;
+  }
+  if (ret == 0) {
+    return;
+  }
+  emu->st.commands++;
+  emu->bootSynced = true;
+  addr = get16le(dec->payload);
+
+  switch (dec->type) {
+  case BOOT_SYNC:
+    reply[0] = 1;
+    reply[1] = BOOT_BLOCK_SIZE;
+    put16le(reply + 2, BOOT_APP_START);
+    put16le(reply + 4, BOOT_APP_END);
+    bootReply(emu, now, dec->type, BOOT_OK, reply, 6);
+    break;
+  case BOOT_BAUD:
+    if (dec->len != 1 || dec->payload[0] > BOOT_BAUD_115200) {
+      bootReply(emu, now, dec->type, BOOT_ERR_COMMAND, NULL, 0);
+      break;
+    }
+    bootReply(emu, now, dec->type, BOOT_OK, NULL, 0);
+    if (emu->imp.baud) {
+      emu->imp.baud = (dec->payload[0] == BOOT_BAUD_115200) ? 115200 : NAMASTE_BAUD;
+    }
+    break;
+  case BOOT_ERASE:
+    if (dec->len != 2) {
+      bootReply(emu, now, dec->type, BOOT_ERR_COMMAND, NULL, 0);
+      break;
+    }
+    ret = bootErase(emu, addr);
+    bootReply(emu, now + SEGMENT_ERASE_SEC, dec->type, (unsigned char)ret, NULL, 0);
+    break;
+  case BOOT_WRITE:
+    if (dec->len <= 2) {
+      bootReply(emu, now, dec->type, BOOT_ERR_COMMAND, NULL, 0);
+      break;
+    }
+    ret = bootWrite(emu, addr, dec->payload + 2, (unsigned char)(dec->len - 2));
+    bootReply(emu, now + (dec->len - 2) * BLOCK_BYTE_SEC, dec->type, (unsigned char)ret, NULL, 0);
+    break;
+  case BOOT_CRC:
+    if (dec->len != 4) {
+      bootReply(emu, now, dec->type, BOOT_ERR_COMMAND, NULL, 0);
+    } else {
+      uint16_t len = get16le(dec->payload + 2);
+      uint16_t crc = CRC16_INIT;
+      while (len--) {
+        crc = crc16Update(crc, emu->flash[addr++]);
+      }
+      put16le(reply, crc);
+      bootReply(emu, now, dec->type, BOOT_OK, reply, 2);
+    }
+    break;
+  case BOOT_GO:
+    if (!appValid(emu)) {
+      bootReply(emu, now, dec->type, BOOT_ERR_NO_APP, NULL, 0);
+      break;
+    }
+    bootReply(emu, now, dec->type, BOOT_OK, NULL, 0);
+    startApp(emu, emu->txFree);
+    break;
+  default:
+    bootReply(emu, now, dec->type, BOOT_ERR_COMMAND, NULL, 0);
+    break;
+  }
+}
+
+// mirror of USCI0RX_ISR
+static void deviceRx(struct emu *emu, double now, unsigned char c) {
+  struct device *dev = &emu->dev;
+
+  if (dev->mode == BOOTMODE) {
+    bootRx(emu, now, c);
+    return;
+  }
+  if (dev->mode != UARTMODE && dev->mode != STREAMMODE) {   /* USCI is held in reset */
+    return;
+  }
+  emu->busyUntil = now;
+
+  if (dev->mode == STREAMMODE) {
+    if (c == CMD_STREAM_STOP) {
+      commitBucket(dev);              /* stopSensing() */
+      endClosedRun(dev, dev->curTimestamp);
+      dev->mode = UARTMODE;
+      transmitChar(emu, now, ACK_VALUE);
+    }
+    return;
+  }
+
+  if (dev->recvingTimestamp) {
+    if (dev->sendingIndex < TIMESTAMP_BYTES) {
+      dev->rcvTimestamp |= ((uint32_t)c) << (8 * dev->sendingIndex);
+    } else {
+      dev->rcvPhase |= (uint16_t)(c << (8 * (dev->sendingIndex - TIMESTAMP_BYTES)));
+    }
+
+    if (++dev->sendingIndex == dev->rcvLength) {
+      dev->setTimestamp = dev->rcvTimestamp;
+      dev->setPhase = dev->rcvPhase;
+      if (dev->rcvCommand == CMD_QUIT_PHASED) {
+        /* time was for the 'Q' byte, add the whole ticks since then */
+        double ticks = floor((deviceClock(emu, now) - dev->rcvStartClock) * TIMER_TICKS_PER_SEC);
+        setDeviceClock(emu, now, dev->rcvTimestamp + (dev->rcvPhase + ticks) / TIMER_TICKS_PER_SEC);
+      } else {
+        setDeviceClock(emu, now, dev->rcvTimestamp);
+      }
+      dev->recvingTimestamp = false;
+      if (dev->rcvCommand == CMD_STREAM) {
+        dev->mode = STREAMMODE;       /* streamModeStart() */
+        resetEventFilter(dev);
+        emu->nextSense = now + emu->sensePeriod;
+      } else {
+        dev->mode = UARTDONEMODE;     /* uartModeStop() */
+        if (emu->imp.baud) {
+          emu->imp.baud = NAMASTE_BAUD;
+        }
+      }
+      if (emu->verbose) {
+        fprintf(stderr, "emu: timestamp set to %lu (device - host %+.1f ms)\n", (unsigned long)dev->curTimestamp,
+                (deviceClock(emu, monoSeconds()) - wallSeconds()) * 1000);
+      }
+    }
+    return;
+  }
+
+  if (dev->recvingConfig) {
+    dev->rcvConfig[dev->sendingIndex] = c;
+    if (++dev->sendingIndex == CONFIG_BYTES) {
+      dev->recvingConfig = false;
+      if (dev->rcvConfig[0] == CONFIG_VERSION && dev->rcvConfig[1] >= 1 && dev->rcvConfig[1] <= CONFIG_SENSE_MAX &&
+          dev->rcvConfig[2] != 0 && dev->rcvConfig[3] != 0 && dev->rcvConfig[4] != 0 &&
+          dev->rcvConfig[6] <= STORE_COUNTS && dev->rcvConfig[7] >= 1 && dev->rcvConfig[7] <= CONFIG_BUCKET_HOURS_MAX &&
+          dev->rcvConfig[7] * 3600UL / dev->rcvConfig[1] <= BUCKET_COUNT_MAX &&
+          dev->rcvConfig[8] == 1 && dev->rcvConfig[9] <= SENSE_ANALOG &&
+          get16le(dev->rcvConfig + 10) < get16le(dev->rcvConfig + 12) && get16le(dev->rcvConfig + 12) <= ADC_MAX &&
+          (dev->rcvConfig[6] == dev->config[6] || dev->numRecords == 0)) {
+        memcpy(dev->config, dev->rcvConfig, CONFIG_BYTES);
+        dev->baseBucket = 0;
+        transmitChar(emu, now + SEGMENT_ERASE_SEC, ACK_VALUE);
+      } else {
+        transmitChar(emu, now, NAK_VALUE);
+      }
+    }
+    return;
+  }
+
+  if (dev->recvingBaud) {
+    dev->recvingBaud = false;
+    if (c <= BAUD_CODE_115200) {
+      transmitChar(emu, now, ACK_VALUE);
+      if (emu->imp.baud) {
+        emu->imp.baud = (c == BAUD_CODE_115200) ? NAMASTE_FAST_BAUD : NAMASTE_BAUD;
+      }
+    } else {
+      transmitChar(emu, now, NAK_VALUE);
+    }
+    return;
+  }
+
+  if (dev->recvingRange) {
+    dev->rcvRange[dev->sendingIndex / TIMESTAMP_BYTES] |= ((uint32_t)c) << (8 * (dev->sendingIndex % TIMESTAMP_BYTES));
+    if (++dev->sendingIndex == 2 * TIMESTAMP_BYTES) {
+      dev->recvingRange = false;
+      dev->downloadCount = findRange(dev, dev->rcvRange[0] & TIMESTAMP_MASK, dev->rcvRange[1] & TIMESTAMP_MASK);
+      send16bit(emu, now, dev->downloadCount);
+      dev->sendingIndex = 0;
+    }
+    return;
+  }
+
+  emu->st.commands++;
+  switch (c) {
+  case CMD_QUIT:
+  case CMD_STREAM:
+  case CMD_QUIT_PHASED:
+    dev->rcvStartClock = deviceClock(emu, now);
+    dev->rcvCommand = c;
+    dev->rcvLength = (c == CMD_QUIT_PHASED) ? PHASED_TIME_BYTES : TIMESTAMP_BYTES;
+    dev->sendingIndex = 0;
+    dev->rcvTimestamp = 0;
+    dev->rcvPhase = 0;
+    dev->recvingTimestamp = true;
+    transmitChar(emu, now, ACK_VALUE);
+    break;
+  case CMD_CLOCK:
+    {
+      double clock = deviceClock(emu, now);
+      uint32_t seconds = (uint32_t)clock;
+      send32bit(emu, now, seconds);
+      send16bit(emu, now, (uint16_t)((clock - seconds) * TIMER_TICKS_PER_SEC));
+      send16bit(emu, now, TIMER_TICKS_PER_SEC);
+      send32bit(emu, now, dev->setTimestamp);
+      send16bit(emu, now, dev->setPhase);
+    }
+    break;
+  case CMD_PING:
+    {
+      double clock = deviceClock(emu, now);
+      uint32_t seconds = (uint32_t)clock;
+      uint16_t phase = (uint16_t)((clock - seconds) * TIMER_TICKS_PER_SEC);
+      send32bit(emu, now, seconds);
+      send16bit(emu, now, phase);
+      send16bit(emu, now, phase);     /* reply is sent well within one timer tick */
+    }
+    break;
+  case CMD_RESET:
+    dev->numRecords = 0;
+    clearSummary(dev);
+    dev->downloadCount = 0;
+    dev->bucketStart = 0;
+    dev->bucketOccupied = 0;
+    dev->baseBucket = 0;
+    transmitChar(emu, now, ACK_VALUE);
+    break;
+  case CMD_DOWNLOAD:
+    dev->downloadBase = 0;
+    dev->downloadCount = getNumTimestamps(dev);
+    send16bit(emu, now, dev->downloadCount);
+    dev->sendingIndex = 0;
+    break;
+  case CMD_RANGE:
+    dev->sendingIndex = 0;
+    dev->rcvRange[0] = 0;
+    dev->rcvRange[1] = 0;
+    dev->recvingRange = true;
+    break;
+  case CMD_NEXT:
+    if (dev->sendingIndex < dev->downloadCount) {
+      send32bit(emu, now, getTimestamp(dev, dev->downloadBase + dev->sendingIndex++));
+    }
+    break;
+  case CMD_GET_CONFIG:
+    {
+      unsigned char i;
+      for (i = 0; i < CONFIG_BYTES; i++) {
+        transmitChar(emu, now, dev->config[i]);
+      }
+    }
+    break;
+  case CMD_FILTERED:
+    send16bit(emu, now, dev->filteredEvents);
+    break;
+  case CMD_ADC:
+    send16bit(emu, now, (uint16_t)((dev->matState == MAT_CLOSED ? ADC_CLOSED : ADC_OPEN) +
+                                   rand() % (2 * ADC_NOISE + 1) - ADC_NOISE));
+    break;
+  case CMD_SUMMARY:
+    {
+      unsigned char payload[SUMMARY_BYTES];
+      put16le(payload, dev->summaryEvents);
+      put32le(payload + 2, dev->firstTime);
+      put32le(payload + 6, dev->lastTime);
+      put32le(payload + 10, dev->occupiedSeconds);
+      put16le(payload + 14, dev->droppedRecords);
+      put16le(payload + 16, dev->filteredEvents);
+      sendFrame(emu, now, FRAME_SUMMARY, payload, sizeof(payload));
+    }
+    break;
+  case CMD_SET_CONFIG:
+    dev->sendingIndex = 0;
+    dev->recvingConfig = true;
+    break;
+  case CMD_BAUD:
+    dev->recvingBaud = true;
+    break;
+  case CMD_BOOTLOADER:
+    transmitChar(emu, now, ACK_VALUE);
+    enterBootloader(emu, emu->txFree);    /* reset once the ACK is out */
+    break;
+  default:
+    break;
+  }
+}
+
+/* *** dock sessions *** */
+
+static void printStats(const struct emu *emu) {
+  fprintf(stderr, "emu: session rx %lu tx %lu cmds %lu dropped %lu corrupted %lu overruns %lu\n",
+          emu->st.rxBytes, emu->st.txBytes, emu->st.commands,
+          emu->st.dropped, emu->st.corrupted, emu->st.overruns);
+}
+
+static void dock(struct emu *emu, double now) {
+  emu->docked = true;
+  emu->dockTime = now;
+  if (emu->dev.mode == BOOTMODE) {
+    emu->bootDeadline = now + BOOT_WAIT_MS / 1000.0;  /* reset with the cable in */
+    bootFrameReset(&emu->bootDec);
+  } else {
+    commitBucket(&emu->dev);          /* stopSensing() in uartWaitModeStart() */
+    endClosedRun(&emu->dev, emu->dev.curTimestamp);
+    emu->dev.mode = UARTWAITMODE;
+  }
+  emu->dev.recvingTimestamp = false;
+  emu->dev.recvingConfig = false;
+  emu->dev.recvingRange = false;
+  emu->dev.recvingBaud = false;
+  emu->rxFree = emu->txFree = emu->busyUntil = now;
+  memset(&emu->st, 0, sizeof(emu->st));
+  if (emu->verbose) {
+    fprintf(stderr, "emu: docked, %lu records\n", (unsigned long)emu->dev.numRecords);
+  }
+}
+
+static void undock(struct emu *emu) {
+  emu->docked = false;
+  if (emu->dev.mode != BOOTMODE) {
+    emu->dev.mode = SENSEMODE;
+    if (emu->imp.baud) {
+      emu->imp.baud = NAMASTE_BAUD;   /* back to CLOCK_SLOW */
+    }
+  }
+  wireFlush(&emu->rxq);
+  wireFlush(&emu->txq);
+  printStats(emu);
+}
+
+// read everything the host wrote and schedule its arrival on the RX line
+static void readHost(struct emu *emu, double now) {
+  unsigned char buf[512];
+  ssize_t n;
+
+  while ((n = read(emu->master, buf, sizeof(buf))) > 0) {
+    ssize_t i;
+    for (i = 0; i < n; i++) {
+      unsigned char c = buf[i];
+      double start = (emu->rxFree > now) ? emu->rxFree : now;
+      emu->rxFree = start + byteSeconds(emu->imp.baud);
+      emu->st.rxBytes++;
+      if (impairByte(emu, &c)) {
+        wirePush(&emu->rxq, emu->rxFree + emu->imp.latency, c);
+      }
+    }
+  }
+}
+
+// hand arrived bytes to the device, modelling the single-byte RX buffer
+static void processRx(struct emu *emu, double now) {
+  struct wireByte *b;
+
+  if (emu->dev.mode == UARTWAITMODE && now >= emu->dockTime + emu->imp.dockDelay) {
+    emu->dev.mode = UARTMODE;         /* uartModeStart() */
+  }
+  if (emu->dev.mode == BOOTMODE && !emu->bootSynced && now >= emu->bootDeadline && appValid(emu)) {
+    startApp(emu, emu->bootDeadline);
+  }
+  while (emu->dev.mode == STREAMMODE && now >= emu->nextSense) {
+    senseTick(emu, emu->nextSense);
+    emu->nextSense += emu->sensePeriod;
+  }
+
+  while ((b = wirePeek(&emu->rxq, 0)) != NULL) {
+    double start = (b->when > emu->busyUntil) ? b->when : emu->busyUntil;
+    struct wireByte *next = wirePeek(&emu->rxq, 1);
+    unsigned char c;
+
+    if (start > now) {
+      break;
+    }
+    if (next && b->when < emu->busyUntil && next->when <= start) {
+      emu->st.overruns++;             /* UCA0RXBUF overwritten before the ISR could read it */
+      wirePop(&emu->rxq);
+      continue;
+    }
+    c = b->value;
+    wirePop(&emu->rxq);
+    deviceRx(emu, start, c);
+  }
+}
+
+// write device bytes whose release time has come
+static void flushTx(struct emu *emu, double now) {
+  unsigned char buf[512];
+  size_t n = 0;
+  struct wireByte *b;
+
+  while ((b = wirePeek(&emu->txq, 0)) != NULL && b->when <= now && n < sizeof(buf)) {
+    buf[n++] = b->value;
+    wirePop(&emu->txq);
+  }
+  if (n && write(emu->master, buf, n) < 0 && errno != EAGAIN && errno != EIO) {
+    perror("write");
+  }
+}
+
+// milliseconds until the next queued byte is due
+static int nextTimeout(struct emu *emu, double now) {
+  double next = -1;
+  struct wireByte *b;
+
+  if ((b = wirePeek(&emu->txq, 0)) != NULL) {
+    next = b->when;
+  }
+  if ((b = wirePeek(&emu->rxq, 0)) != NULL) {
+    double when = (b->when > emu->busyUntil) ? b->when : emu->busyUntil;
+    if (next < 0 || when < next) {
+      next = when;
+    }
+  }
+  if (emu->dev.mode == UARTWAITMODE) {
+    double when = emu->dockTime + emu->imp.dockDelay;
+    if (next < 0 || when < next) {
+      next = when;
+    }
+  }
+  if (emu->dev.mode == BOOTMODE && !emu->bootSynced && (next < 0 || emu->bootDeadline < next)) {
+    next = emu->bootDeadline;
+  }
+  if (emu->dev.mode == STREAMMODE && (next < 0 || emu->nextSense < next)) {
+    next = emu->nextSense;
+  }
+  if (next < 0) {
+    return -1;
+  }
+  return (next <= now) ? 0 : (int)((next - now) * 1000.0) + 1;
+}
+
+/* *** logs *** */
+
+// generate alternating open/closed events spaced in whole sense ticks
+static uint32_t *syntheticLog(size_t count, uint32_t startTime) {
+  uint32_t *recs = malloc((count ? count : 1) * sizeof(*recs));
+  uint32_t ts = startTime;
+  unsigned char state = (unsigned char)(rand() & 1);
+  size_t i;
+
+  if (!recs) {
+    perror("malloc");
+    exit(1);
+  }
+  for (i = 0; i < count; i++) {
+    recs[i] = makeRecord(state, ts);
+    state ^= 1;
+    ts += SENSE_PERIOD_SEC * (1 + rand() % SYNTH_MAX_GAP_TICKS);
+  }
+  return recs;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  -l FILE   load raw log (4-byte little-endian records)\n"
+          "  -n N      generate N synthetic records\n"
+          "  -t SEC    start time of synthetic records (default: now - 30 days)\n"
+          "  -b BAUD   pace the wire at BAUD, 0 = unpaced (default %d)\n"
+          "  -L MS     one-way latency in milliseconds\n"
+          "  -D PROB   byte drop probability\n"
+          "  -C PROB   byte corruption probability\n"
+          "  -w MS     dock-to-UART delay (default %d)\n"
+          "  -p SEC    wall seconds per emulated 15 s sense tick while streaming (default 15)\n"
+          "  -E PROB   mat state change probability per sense tick (default %.1f)\n"
+          "  -d PPM    device clock drift (default 0)\n"
+          "  -T SEC    device clock at start-up (default: unset)\n"
+          "  -B        start in the bootloader\n"
+          "  -F FILE   flash image 0x8000-0xFFFF used by the bootloader, saved when the application starts\n"
+          "  -s SEED   random seed\n"
+          "  -k PATH   create a symlink to the slave pty\n"
+          "  -v        verbose\n",
+          prog, NAMASTE_BAUD, DOCK_STABLE_MS, DEFAULT_EVENT_PROB);
+}
+
+int main(int argc, char *argv[]) {
+  struct emu emu;
+  const char *logPath = NULL;
+  const char *linkPath = NULL;
+  long synthCount = -1;
+  uint32_t synthStart = (uint32_t)wallSeconds() - 30 * 24 * 3600;
+  unsigned int seed = (unsigned int)time(NULL);
+  int opt;
+
+  memset(&emu, 0, sizeof(emu));
+  emu.imp.baud = NAMASTE_BAUD;
+  emu.imp.dockDelay = DOCK_STABLE_MS / 1000.0;
+  emu.dev.mode = SENSEMODE;
+  emu.sensePeriod = SENSE_PERIOD_SEC;
+  emu.eventProb = DEFAULT_EVENT_PROB;
+  emu.dev.config[0] = CONFIG_VERSION;
+  emu.dev.config[1] = CONFIG_DEFAULT_SENSE;
+  emu.dev.config[2] = CONFIG_DEFAULT_WAIT_HIGH;
+  emu.dev.config[3] = CONFIG_DEFAULT_DONE_LOW;
+  emu.dev.config[4] = CONFIG_DEFAULT_CONFIRM;
+  emu.dev.config[5] = CONFIG_DEFAULT_DWELL;
+  emu.dev.config[6] = CONFIG_DEFAULT_STORAGE;
+  emu.dev.config[7] = CONFIG_DEFAULT_BUCKET_HOURS;
+  emu.dev.config[8] = 1;              /* one sensor channel */
+  emu.dev.config[9] = CONFIG_DEFAULT_SENSE_MODE;
+  put16le(emu.dev.config + 10, CONFIG_DEFAULT_CLOSED);
+  put16le(emu.dev.config + 12, CONFIG_DEFAULT_OPEN);
+  emu.dev.matState = 0xFF;
+  resetEventFilter(&emu.dev);
+
+  while ((opt = getopt(argc, argv, "l:n:t:b:L:D:C:w:p:E:d:T:BF:s:k:vh")) != -1) {
+    switch (opt) {
+    case 'l': logPath = optarg; break;
+    case 'n': synthCount = atol(optarg); break;
+    case 't': synthStart = (uint32_t)strtoul(optarg, NULL, 0); break;
+    case 'b': emu.imp.baud = strtoul(optarg, NULL, 0); break;
+    case 'L': emu.imp.latency = atof(optarg) / 1000.0; break;
+    case 'D': emu.imp.dropProb = atof(optarg); break;
+    case 'C': emu.imp.corruptProb = atof(optarg); break;
+    case 'w': emu.imp.dockDelay = atof(optarg) / 1000.0; break;
+    case 'p': emu.sensePeriod = atof(optarg); break;
+    case 'E': emu.eventProb = atof(optarg); break;
+    case 'd': emu.driftPpm = atof(optarg); break;
+    case 'T': setDeviceClock(&emu, monoSeconds(), (uint32_t)strtoul(optarg, NULL, 0)); break;
+    case 'B': emu.dev.mode = BOOTMODE; break;
+    case 'F': emu.flashPath = optarg; break;
+    case 's': seed = (unsigned int)strtoul(optarg, NULL, 0); break;
+    case 'k': linkPath = optarg; break;
+    case 'v': emu.verbose = true; break;
+    default: usage(argv[0]); return 2;
+    }
+  }
+  srand(seed);
+
+  emu.flash = malloc(FLASH_SIZE);
+  if (!emu.flash) {
+    perror("malloc");
+    return 1;
+  }
+  memset(emu.flash, 0xFF, FLASH_SIZE);
+  if (emu.flashPath && !loadFlash(&emu) && emu.verbose) {
+    fprintf(stderr, "emu: %s not found, flash is erased\n", emu.flashPath);
+  }
+  if (emu.dev.mode == BOOTMODE) {
+    enterBootloader(&emu, monoSeconds());
+  }
+
+  if (logPath) {
+    if (loadLog(logPath, &emu.dev.records, &emu.dev.numRecords) < 0) {
+      perror(logPath);
+      return 1;
+    }
+  } else if (synthCount >= 0) {
+    emu.dev.records = syntheticLog((size_t)synthCount, synthStart);
+    emu.dev.numRecords = (size_t)synthCount;
+  }
+  emu.dev.recordsCap = emu.dev.numRecords;
+  if (emu.dev.numRecords > MAX_RECORDS) {
+    fprintf(stderr, "emu: %lu records do not fit the 16-bit count, serving the first %d\n",
+            (unsigned long)emu.dev.numRecords, MAX_RECORDS);
+    emu.dev.numRecords = MAX_RECORDS;
+  }
+
+  emu.master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (emu.master < 0 || grantpt(emu.master) < 0 || unlockpt(emu.master) < 0) {
+    perror("pty");
+    return 1;
+  }
+  setRawMode(emu.master, 0);
+  printf("%s\n", ptsname(emu.master));
+  fflush(stdout);
+  if (linkPath) {
+    unlink(linkPath);
+    if (symlink(ptsname(emu.master), linkPath) < 0) {
+      perror(linkPath);
+      return 1;
+    }
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  while (!quitting) {
+    struct pollfd pfd;
+    double now = monoSeconds();
+    int ret;
+
+    pfd.fd = emu.master;
+    pfd.events = POLLIN;
+    ret = poll(&pfd, 1, emu.docked ? nextTimeout(&emu, now) : UNDOCKED_POLL_MS);
+    if (ret < 0 && errno != EINTR) {
+      perror("poll");
+      break;
+    }
+    now = monoSeconds();
+
+    if (ret > 0 && (pfd.revents & POLLHUP)) {  /* no client has the slave open */
+      if (emu.docked) {
+        readHost(&emu, now);
+        processRx(&emu, HUGE_VAL);      /* cable stays connected while the last bytes drain */
+        undock(&emu);
+      } else {
+        struct timespec ts = { 0, UNDOCKED_POLL_MS * 1000000L };
+        nanosleep(&ts, NULL);
+      }
+      continue;
+    }
+    if (!emu.docked) {
+      dock(&emu, now);
+    }
+    if (ret > 0 && (pfd.revents & POLLIN)) {
+      readHost(&emu, now);
+    }
+    processRx(&emu, now);
+    flushTx(&emu, now);
+  }
+
+  if (emu.docked) {
+    printStats(&emu);
+  }
+  if (linkPath) {
+    unlink(linkPath);
+  }
+  close(emu.master);
+  free(emu.dev.records);
+  free(emu.flash);
+  return 0;
+}
@@ -0,0 +1,527 @@
+/*
+    namasteFlash.c
+    Firmware updater for boards running the UART bootloader (BOOT/uartBoot)
+
+    Loads a TI-TXT or Intel HEX image, moves its interrupt vectors from
+    0xFFE0 to the bootloader's proxy vector table at 0xF7E0 when the image was
+    linked for a bare device, then erases the application area, programs it
+    one flash row per frame and checks every segment against a CRC computed
+    by the device. The segment holding the vectors is erased first and the row
+    holding them is written last, so an interrupted update leaves the board
+    in the bootloader instead of starting half an application.
+
+    With -e the running namasteTrunk firmware is asked to reset into the
+    bootloader with 'B'. Otherwise plug in the cable (or reset the board)
+    while the tool is waiting for the bootloader. Note that namasteTrunk
+    clears its log when it starts, so download it before updating.
+
+    Build:  gcc -Wall -O2 -o namasteFlash namasteFlash.c namasteProto.c
+    Usage:  namasteFlash [-e] [-b 115200] [-n] firmware.txt /dev/ttyUSB0
+*/
+
+#define _GNU_SOURCE
+#include "namasteProto.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+/* defaults */
+#define DEFAULT_BAUD        115200
+#define REPLY_TIMEOUT_MS    300     /* covers a segment erase at 9600 baud */
+#define MAX_RETRIES         5
+#define SYNC_TIMEOUT_MS     10000   /* time allowed to plug in or reset the board */
+#define SYNC_INTERVAL_MS    100     /* well within BOOT_WAIT_MS */
+#define ENTER_TIMEOUT_MS    3000    /* 'B' is only heard once namasteTrunk is in UART mode */
+#define ENTER_INTERVAL_MS   250
+#define VECTOR_BYTES        32
+#define ADDR_SPACE          0x10000
+
+struct flashImage {
+  unsigned char data[ADDR_SPACE];
+  bool used[ADDR_SPACE];
+  unsigned long bytes;
+};
+
+struct bootLink {
+  int fd;
+  struct bootDecoder dec;
+  unsigned char reply[BOOT_MAX_PAYLOAD];
+  unsigned char replyLen;
+  unsigned long retries;
+};
+
+/* *** images *** */
+
+static int putByte(struct flashImage *img, unsigned long addr, unsigned char value) {
+  if (addr >= ADDR_SPACE) {
+    fprintf(stderr, "address 0x%lX is outside the 16-bit address space\n", addr);
+    return -1;
+  }
+  if (!img->used[addr]) {
+    img->used[addr] = true;
+    img->bytes++;
+  }
+  img->data[addr] = value;
+  return 0;
+}
+
+static int hexByte(const char *s) {
+  unsigned int value;
+  if (!isxdigit((unsigned char)s[0]) || !isxdigit((unsigned char)s[1]) || sscanf(s, "%2x", &value) != 1) {
+    return -1;
+  }
+  return (int)value;
+}
+
+// TI-TXT: "@ADDR" lines followed by lines of hex bytes, "q" ends the file
+static int loadTiTxt(FILE *fp, struct flashImage *img) {
+  char line[256];
+  unsigned long addr = 0;
+  unsigned int lineNo = 0;
+
+  while (fgets(line, sizeof(line), fp)) {
+    char *p = line;
+    lineNo++;
+    while (isspace((unsigned char)*p)) {
+      p++;
+    }
+    if (*p == 'q' || *p == 'Q') {
+      return 0;
+    }
+    if (*p == '@') {
+      addr = strtoul(p + 1, NULL, 16);
+      continue;
+    }
+    while (*p) {
+      int value;
+      if (isspace((unsigned char)*p)) {
+        p++;
+        continue;
+      }
+      if ((value = hexByte(p)) < 0) {
+        fprintf(stderr, "line %u: bad hex byte\n", lineNo);
+        return -1;
+      }
+      if (putByte(img, addr++, (unsigned char)value) < 0) {
+        return -1;
+      }
+      p += 2;
+    }
+  }
+  return 0;
+}
+
+// Intel HEX: ":LLAAAATT" records with data and checksum
+static int loadIntelHex(FILE *fp, struct flashImage *img) {
+  char line[600];
+  unsigned long base = 0;
+  unsigned int lineNo = 0;
+
+  while (fgets(line, sizeof(line), fp)) {
+    unsigned char rec[256 + 5];
+    unsigned char sum = 0;
+    size_t n = 0;
+    char *p = line;
+    int value;
+    unsigned int i;
+
+    lineNo++;
+    while (isspace((unsigned char)*p)) {
+      p++;
+    }
+    if (*p == '\0') {
+      continue;
+    }
+    if (*p++ != ':') {
+      fprintf(stderr, "line %u: record does not start with ':'\n", lineNo);
+      return -1;
+    }
+    while (n < sizeof(rec) && (value = hexByte(p)) >= 0) {
+      rec[n++] = (unsigned char)value;
+      sum = (unsigned char)(sum + value);
+      p += 2;
+    }
+    if (n < 5 || n != (size_t)rec[0] + 5u || sum != 0) {
+      fprintf(stderr, "line %u: bad record length or checksum\n", lineNo);
+      return -1;
+    }
+    switch (rec[3]) {
+    case 0x00:                        /* data */
+      for (i = 0; i < rec[0]; i++) {
+        if (putByte(img, base + ((rec[1] << 8) | rec[2]) + i, rec[4 + i]) < 0) {
+          return -1;
+        }
+      }
+      break;
+    case 0x01:                        /* end of file */
+      return 0;
+    case 0x02:                        /* extended segment address */
+      base = (unsigned long)((rec[4] << 8) | rec[5]) << 4;
+      break;
+    case 0x04:                        /* extended linear address */
+      base = (unsigned long)((rec[4] << 8) | rec[5]) << 16;
+      break;
+    default:                          /* start addresses do not matter here */
+      break;
+    }
+  }
+  return 0;
+}
+
+static int loadImage(const char *path, struct flashImage *img) {
+  FILE *fp = fopen(path, "r");
+  int c;
+  int ret;
+
+  if (!fp) {
+    perror(path);
+    return -1;
+  }
+  while ((c = fgetc(fp)) != EOF && isspace(c)) {
+  }
+  ungetc(c, fp);
+  if (c == ':') {
+    ret = loadIntelHex(fp, img);
+  } else if (c == '@') {
+    ret = loadTiTxt(fp, img);
+  } else {
+    fprintf(stderr, "%s: neither TI-TXT nor Intel HEX\n", path);
+    ret = -1;
+  }
+  fclose(fp);
+  return ret;
+}
+
+static bool rangeUsed(const struct flashImage *img, unsigned long start, unsigned long end) {
+  unsigned long addr;
+  for (addr = start; addr < end; addr++) {
+    if (img->used[addr]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// move vectors linked at the hardware vector table into the proxy vector table
+// and make sure everything else lies inside the application area
+static int prepareImage(struct flashImage *img) {
+  unsigned long addr;
+
+  if (rangeUsed(img, BOOT_HW_VECTORS, ADDR_SPACE)) {
+    if (rangeUsed(img, BOOT_APP_VECTORS, BOOT_APP_VECTORS + VECTOR_BYTES)) {
+      fprintf(stderr, "image has vectors at both 0x%04X and 0x%04X\n", BOOT_HW_VECTORS, BOOT_APP_VECTORS);
+      return -1;
+    }
+    for (addr = BOOT_HW_VECTORS; addr < ADDR_SPACE; addr++) {
+      unsigned long to = addr - BOOT_HW_VECTORS + BOOT_APP_VECTORS;
+      img->data[to] = img->data[addr];
+      img->used[to] = img->used[addr];
+      img->used[addr] = false;
+    }
+    fprintf(stderr, "moved interrupt vectors to 0x%04X\n", BOOT_APP_VECTORS);
+  }
+  for (addr = 0; addr < ADDR_SPACE; addr++) {
+    if (img->used[addr] && (addr < BOOT_APP_START || addr >= BOOT_APP_END)) {
+      fprintf(stderr, "image has data at 0x%04lX, outside the application area 0x%04X-0x%04X\n",
+              addr, BOOT_APP_START, BOOT_APP_END - 1);
+      return -1;
+    }
+  }
+  if (!img->used[BOOT_APP_END - 2] || !img->used[BOOT_APP_END - 1]) {
+    fprintf(stderr, "image has no reset vector\n");
+    return -1;
+  }
+  return 0;
+}
+
+/* *** link *** */
+
+static void sleepMs(int ms) {
+  poll(NULL, 0, ms);
+}
+
+// send one request and wait for its reply, returns the status byte or -1 if nothing usable came back
+static int bootRequest(struct bootLink *link, unsigned char type, const unsigned char *payload,
+                       unsigned char len, int timeoutMs, int tries) {
+  unsigned char frame[BOOT_FRAME_OVERHEAD + BOOT_MAX_PAYLOAD];
+  size_t n = bootFrameEncode(frame, type, payload, len);
+  struct pollfd pfd;
+
+  pfd.fd = link->fd;
+  pfd.events = POLLIN;
+  while (tries-- > 0) {
+    double deadline = monoSeconds() + timeoutMs / 1000.0;
+
+    tcflush(link->fd, TCIFLUSH);
+    bootFrameReset(&link->dec);
+    if (write(link->fd, frame, n) != (ssize_t)n) {
+      return -1;
+    }
+    while (true) {
+      int waitMs = (int)((deadline - monoSeconds()) * 1000.0);
+      unsigned char c;
+      int ret;
+
+      if (waitMs <= 0 || poll(&pfd, 1, waitMs) <= 0) {
+        break;                        /* no reply, try again */
+      }
+      if (read(link->fd, &c, 1) != 1) {
+        continue;
+      }
+      ret = bootFrameFeed(&link->dec, c);
+      if (ret < 0 || (ret > 0 && (link->dec.type != type || link->dec.len == 0))) {
+        break;                        /* garbled, or the device did not understand us */
+      }
+      if (ret > 0) {
+        link->replyLen = (unsigned char)(link->dec.len - 1);
+        memcpy(link->reply, link->dec.payload + 1, link->replyLen);
+        return link->dec.payload[0];
+      }
+    }
+    link->retries++;
+  }
+  return -1;
+}
+
+// ask the running firmware to reset into the bootloader
+static int enterBootloader(struct bootLink *link) {
+  struct pollfd pfd;
+  double deadline = monoSeconds() + ENTER_TIMEOUT_MS / 1000.0;
+  const unsigned char cmd = CMD_BOOTLOADER;
+
+  pfd.fd = link->fd;
+  pfd.events = POLLIN;
+  while (monoSeconds() < deadline) {
+    unsigned char c;
+    tcflush(link->fd, TCIFLUSH);
+    if (write(link->fd, &cmd, 1) != 1) {
+      return -1;
+    }
+    if (poll(&pfd, 1, ENTER_INTERVAL_MS) > 0 && read(link->fd, &c, 1) == 1 && c == ACK_VALUE) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static int syncBoot(struct bootLink *link, int timeoutMs) {
+  double deadline = monoSeconds() + timeoutMs / 1000.0;
+
+  while (monoSeconds() < deadline) {
+    if (bootRequest(link, BOOT_SYNC, NULL, 0, SYNC_INTERVAL_MS, 1) == BOOT_OK && link->replyLen == 6) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static int switchBaud(struct bootLink *link, unsigned long baud) {
+  unsigned char code = (baud == 115200) ? BOOT_BAUD_115200 : BOOT_BAUD_9600;
+
+  if (baud == NAMASTE_BAUD) {
+    return 0;
+  }
+  if (bootRequest(link, BOOT_BAUD, &code, 1, REPLY_TIMEOUT_MS, MAX_RETRIES) != BOOT_OK) {
+    return -1;
+  }
+  tcdrain(link->fd);
+  if (setRawMode(link->fd, baud) < 0) {
+    return -1;
+  }
+  sleepMs(10);                        /* DCO settles after the switch */
+  return syncBoot(link, REPLY_TIMEOUT_MS * MAX_RETRIES);
+}
+
+/* *** programming *** */
+
+// erase the application area, starting with the segment that holds the vectors
+static int eraseApp(struct bootLink *link) {
+  unsigned long seg = BOOT_APP_END - BOOT_SEGMENT_SIZE;
+
+  while (true) {
+    unsigned char payload[2];
+    int status;
+
+    put16le(payload, (uint16_t)seg);
+    status = bootRequest(link, BOOT_ERASE, payload, sizeof(payload), REPLY_TIMEOUT_MS, MAX_RETRIES);
+    if (status != BOOT_OK) {
+      fprintf(stderr, "erase 0x%04lX failed (status %d)\n", seg, status);
+      return -1;
+    }
+    if (seg == BOOT_APP_END - BOOT_SEGMENT_SIZE) {
+      seg = BOOT_APP_START;
+    } else {
+      seg += BOOT_SEGMENT_SIZE;
+    }
+    if (seg == BOOT_APP_END - BOOT_SEGMENT_SIZE) {
+      return 0;
+    }
+  }
+}
+
+// program the used part of one flash row, unused bytes in between stay erased
+static int writeRow(struct bootLink *link, const struct flashImage *img, unsigned long row) {
+  unsigned char payload[BOOT_MAX_PAYLOAD];
+  unsigned long first = row;
+  unsigned long last = row + BOOT_BLOCK_SIZE - 1;
+  unsigned long addr;
+  int status;
+
+  while (first <= last && !img->used[first]) {
+    first++;
+  }
+  if (first > last) {
+    return 0;
+  }
+  while (!img->used[last]) {
+    last--;
+  }
+  put16le(payload, (uint16_t)first);
+  for (addr = first; addr <= last; addr++) {
+    payload[2 + addr - first] = img->used[addr] ? img->data[addr] : 0xFF;
+  }
+  status = bootRequest(link, BOOT_WRITE, payload, (unsigned char)(2 + last - first + 1),
+                       REPLY_TIMEOUT_MS, MAX_RETRIES);
+  if (status != BOOT_OK) {
+    fprintf(stderr, "write 0x%04lX failed (status %d)\n", first, status);
+    return -1;
+  }
+  return 1;
+}
+
+// write every row, the one with the vectors last, returns the number of rows written
+static long writeImage(struct bootLink *link, const struct flashImage *img) {
+  unsigned long vectorRow = BOOT_APP_END - BOOT_BLOCK_SIZE;
+  unsigned long row;
+  long rows = 0;
+  int ret;
+
+  for (row = BOOT_APP_START; row < vectorRow; row += BOOT_BLOCK_SIZE) {
+    if ((ret = writeRow(link, img, row)) < 0) {
+      return -1;
+    }
+    rows += ret;
+  }
+  if ((ret = writeRow(link, img, vectorRow)) < 0) {
+    return -1;
+  }
+  return rows + ret;
+}
+
+// compare each segment with the CRC the device computes over it
+static int verifyImage(struct bootLink *link, const struct flashImage *img) {
+  unsigned long seg;
+  int bad = 0;
+
+  for (seg = BOOT_APP_START; seg < BOOT_APP_END; seg += BOOT_SEGMENT_SIZE) {
+    unsigned char payload[4];
+    uint16_t crc = CRC16_INIT;
+    unsigned long addr;
+
+    for (addr = seg; addr < seg + BOOT_SEGMENT_SIZE; addr++) {
+      crc = crc16Update(crc, img->used[addr] ? img->data[addr] : 0xFF);
+    }
+    put16le(payload, (uint16_t)seg);
+    put16le(payload + 2, BOOT_SEGMENT_SIZE);
+    if (bootRequest(link, BOOT_CRC, payload, sizeof(payload), REPLY_TIMEOUT_MS, MAX_RETRIES) != BOOT_OK ||
+        link->replyLen != 2) {
+      fprintf(stderr, "no CRC for 0x%04lX\n", seg);
+      return -1;
+    }
+    if (get16le(link->reply) != crc) {
+      fprintf(stderr, "segment 0x%04lX does not match the image\n", seg);
+      bad++;
+    }
+  }
+  return bad ? -1 : 0;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [options] IMAGE PORT\n"
+          "  IMAGE     TI-TXT or Intel HEX file\n"
+          "  -e        ask running namasteTrunk firmware to enter the bootloader first\n"
+          "  -b BAUD   programming baud rate, 9600 or 115200 (default %d)\n"
+          "  -n        do not start the application afterwards\n",
+          prog, DEFAULT_BAUD);
+}
+
+int main(int argc, char *argv[]) {
+  static struct flashImage img;
+  struct bootLink link;
+  unsigned long baud = DEFAULT_BAUD;
+  bool enter = false;
+  bool start = true;
+  double t0;
+  long rows;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "eb:nh")) != -1) {
+    switch (opt) {
+    case 'e': enter = true; break;
+    case 'b': baud = strtoul(optarg, NULL, 0); break;
+    case 'n': start = false; break;
+    default:
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (optind + 2 != argc || (baud != 9600 && baud != 115200)) {
+    usage(argv[0]);
+    return 2;
+  }
+  if (loadImage(argv[optind], &img) < 0 || prepareImage(&img) < 0) {
+    return 1;
+  }
+  fprintf(stderr, "%s: %lu bytes\n", argv[optind], img.bytes);
+
+  memset(&link, 0, sizeof(link));
+  link.fd = open(argv[optind + 1], O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (link.fd < 0 || setRawMode(link.fd, NAMASTE_BAUD) < 0) {
+    perror(argv[optind + 1]);
+    return 1;
+  }
+
+  if (enter && enterBootloader(&link) < 0) {
+    fprintf(stderr, "firmware did not acknowledge '%c'\n", CMD_BOOTLOADER);
+    return 1;
+  }
+  fprintf(stderr, "waiting for the bootloader...\n");
+  if (syncBoot(&link, SYNC_TIMEOUT_MS) < 0) {
+    fprintf(stderr, "no answer from the bootloader\n");
+    return 1;
+  }
+  fprintf(stderr, "bootloader version %u, application area 0x%04X-0x%04X\n",
+          link.reply[0], get16le(link.reply + 2), get16le(link.reply + 4) - 1);
+  if (link.reply[1] != BOOT_BLOCK_SIZE || get16le(link.reply + 2) != BOOT_APP_START ||
+      get16le(link.reply + 4) != BOOT_APP_END) {
+    fprintf(stderr, "unexpected bootloader memory map\n");
+    return 1;
+  }
+  if (switchBaud(&link, baud) < 0) {
+    fprintf(stderr, "could not switch to %lu baud\n", baud);
+    return 1;
+  }
+
+  t0 = monoSeconds();
+  if (eraseApp(&link) < 0 || (rows = writeImage(&link, &img)) < 0 || verifyImage(&link, &img) < 0) {
+    return 1;
+  }
+  fprintf(stderr, "programmed and verified %ld rows in %.2f s at %lu baud, %lu retries\n",
+          rows, monoSeconds() - t0, baud, link.retries);
+
+  if (start && bootRequest(&link, BOOT_GO, NULL, 0, REPLY_TIMEOUT_MS, MAX_RETRIES) != BOOT_OK) {
+    fprintf(stderr, "bootloader did not start the application\n");
+    return 1;
+  }
+  close(link.fd);
+  return 0;
+}
@@ -0,0 +1,287 @@
+/*
+    namasteMemDump.c
+    Memory image reader for the viewMemTest dump service
+
+    Asks MEMORY/viewMemTest for an address range with 'm' and rebuilds the
+    image from the checksummed blocks it streams back. Blocks that fail their
+    CRC or never arrive are requested again by range, so a noisy link costs a
+    few blocks rather than the whole dump. The image can be saved, compared
+    against a reference image, or printed as a hex dump.
+
+    Build:  gcc -Wall -O2 -o namasteMemDump namasteMemDump.c namasteProto.c
+    Usage:  namasteMemDump [-a 0x8000] [-l 0x8000] [-o image.bin] [-d ref.bin] /dev/ttyUSB0
+*/
+
+#define _GNU_SOURCE
+#include "namasteProto.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+/* dump protocol (see MEMORY/viewMemTest/main.c) */
+#define CMD_DUMP            'm'     /* followed by start address (2) and length (2) */
+#define DUMP_BLOCK_SIZE     64
+#define DUMP_HEADER_BYTES   3       /* address (2), n (1) */
+#define DUMP_CRC_BYTES      2
+#define DUMP_BAUD           115200
+
+/* defaults */
+#define DEFAULT_ADDR        0x8000  /* main flash of the MSP430F2274 */
+#define DEFAULT_LEN         0x8000
+#define REPLY_TIMEOUT_MS    500     /* silence that ends a pass */
+#define MAX_PASSES          4       /* first pass plus retries of missing ranges */
+
+struct dumpImage {
+  uint16_t base;
+  uint32_t len;
+  unsigned char *data;
+  bool *valid;
+  unsigned long badBlocks;
+};
+
+// read exactly len bytes, returns -1 on timeout
+static int readExact(int fd, unsigned char *buf, size_t len) {
+  struct pollfd pfd;
+  size_t got = 0;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  while (got < len) {
+    ssize_t n;
+    if (poll(&pfd, 1, REPLY_TIMEOUT_MS) <= 0) {
+      return -1;
+    }
+    n = read(fd, buf + got, len - got);
+    if (n < 0 && errno != EINTR && errno != EAGAIN) {
+      return -1;
+    }
+    if (n > 0) {
+      got += (size_t)n;
+    }
+  }
+  return 0;
+}
+
+// request one range and store every good block, returns 0 when the end block arrived
+static int dumpPass(int fd, struct dumpImage *img, uint16_t addr, uint16_t len) {
+  unsigned char req[5];
+  unsigned char blk[DUMP_HEADER_BYTES + DUMP_BLOCK_SIZE + DUMP_CRC_BYTES];
+
+  req[0] = CMD_DUMP;
+  put16le(req + 1, addr);
+  put16le(req + 3, len);
+  tcflush(fd, TCIFLUSH);
+  if (write(fd, req, sizeof(req)) != sizeof(req)) {
+    return -1;
+  }
+
+  while (true) {
+    uint16_t blkAddr;
+    unsigned char n;
+    unsigned char i;
+
+    if (readExact(fd, blk, DUMP_HEADER_BYTES) < 0) {
+      return -1;
+    }
+    blkAddr = get16le(blk);
+    n = blk[2];
+    if (n > DUMP_BLOCK_SIZE) {      /* lost sync, the rest of this pass is unusable */
+      img->badBlocks++;
+      return -1;
+    }
+    if (readExact(fd, blk + DUMP_HEADER_BYTES, n + DUMP_CRC_BYTES) < 0) {
+      return -1;
+    }
+    if (crc16(CRC16_INIT, blk, DUMP_HEADER_BYTES + n) != get16le(blk + DUMP_HEADER_BYTES + n)) {
+      img->badBlocks++;
+      continue;                     /* picked up again by the next pass */
+    }
+    if (n == 0) {
+      return 0;
+    }
+    for (i = 0; i < n; i++) {
+      uint32_t off = (uint16_t)(blkAddr + i - img->base);
+      if (off < img->len) {
+        img->data[off] = blk[DUMP_HEADER_BYTES + i];
+        img->valid[off] = true;
+      }
+    }
+  }
+}
+
+static uint32_t countMissing(const struct dumpImage *img) {
+  uint32_t off;
+  uint32_t missing = 0;
+  for (off = 0; off < img->len; off++) {
+    missing += !img->valid[off];
+  }
+  return missing;
+}
+
+// request every range that is still missing
+static void dumpMissing(int fd, struct dumpImage *img) {
+  uint32_t off = 0;
+
+  while (off < img->len) {
+    uint32_t end;
+    if (img->valid[off]) {
+      off++;
+      continue;
+    }
+    for (end = off; end < img->len && !img->valid[end]; end++) {
+    }
+    dumpPass(fd, img, (uint16_t)(img->base + off), (uint16_t)(end - off));
+    off = end;
+  }
+}
+
+// print the ranges where the image differs from a reference image of the same range,
+// returns the number of differing bytes or -1 if the reference cannot be read
+static long diffImage(const struct dumpImage *img, const char *path) {
+  FILE *fp = fopen(path, "rb");
+  unsigned char *ref;
+  size_t refLen;
+  uint32_t off = 0;
+  long diffs = 0;
+
+  if (!fp) {
+    perror(path);
+    return -1;
+  }
+  ref = malloc(img->len);
+  refLen = ref ? fread(ref, 1, img->len, fp) : 0;
+  fclose(fp);
+  if (refLen < img->len) {
+    fprintf(stderr, "%s: reference is shorter than the dump (%zu bytes)\n", path, refLen);
+  }
+  while (off < refLen) {
+    uint32_t end;
+    if (img->data[off] == ref[off]) {
+      off++;
+      continue;
+    }
+    for (end = off; end < refLen && img->data[end] != ref[end]; end++) {
+    }
+    printf("differs 0x%04X-0x%04X (%u bytes)\n", (unsigned)(img->base + off),
+           (unsigned)(img->base + end - 1), (unsigned)(end - off));
+    diffs += end - off;
+    off = end;
+  }
+  free(ref);
+  return diffs;
+}
+
+static void hexDump(const struct dumpImage *img) {
+  uint32_t off;
+  for (off = 0; off < img->len; off++) {
+    if (off % 16 == 0) {
+      printf("%04X:", (unsigned)(img->base + off));
+    }
+    if (img->valid[off]) {
+      printf(" %02X", img->data[off]);
+    } else {
+      printf(" ??");
+    }
+    if (off % 16 == 15 || off + 1 == img->len) {
+      putchar('\n');
+    }
+  }
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [options] PORT\n"
+          "  -a ADDR   start address (default 0x%04X)\n"
+          "  -l LEN    number of bytes, at most 0xFFFF (default 0x%04X)\n"
+          "  -o FILE   save the image (missing bytes as 0xFF) instead of printing it\n"
+          "  -d FILE   compare against a reference image of the same range\n"
+          "  -b BAUD   baud rate (default %d)\n",
+          prog, DEFAULT_ADDR, DEFAULT_LEN, DUMP_BAUD);
+}
+
+int main(int argc, char *argv[]) {
+  struct dumpImage img;
+  const char *outPath = NULL;
+  const char *refPath = NULL;
+  unsigned long baud = DUMP_BAUD;
+  unsigned long len = DEFAULT_LEN;
+  uint32_t missing;
+  double start, dt;
+  int fd, opt, pass;
+
+  memset(&img, 0, sizeof(img));
+  img.base = DEFAULT_ADDR;
+  while ((opt = getopt(argc, argv, "a:l:o:d:b:h")) != -1) {
+    switch (opt) {
+    case 'a': img.base = (uint16_t)strtoul(optarg, NULL, 0); break;
+    case 'l': len = strtoul(optarg, NULL, 0); break;
+    case 'o': outPath = optarg; break;
+    case 'd': refPath = optarg; break;
+    case 'b': baud = strtoul(optarg, NULL, 0); break;
+    default:
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (optind + 1 != argc || len == 0 || len > 0xFFFF) {
+    usage(argv[0]);
+    return 2;
+  }
+  if (img.base + len > 0x10000) {
+    len = 0x10000 - img.base;       /* the device stops at the top of memory too */
+  }
+  img.len = (uint32_t)len;
+  img.data = malloc(img.len);
+  img.valid = calloc(img.len, sizeof(*img.valid));
+  if (!img.data || !img.valid) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  memset(img.data, 0xFF, img.len);
+
+  fd = open(argv[optind], O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0 || setRawMode(fd, baud) < 0) {
+    perror(argv[optind]);
+    return 1;
+  }
+
+  start = monoSeconds();
+  dumpPass(fd, &img, img.base, (uint16_t)img.len);
+  for (pass = 1; pass < MAX_PASSES && (missing = countMissing(&img)) != 0; pass++) {
+    fprintf(stderr, "pass %d: %u bytes missing, retrying\n", pass, (unsigned)missing);
+    dumpMissing(fd, &img);
+  }
+  dt = monoSeconds() - start;
+  close(fd);
+
+  missing = countMissing(&img);
+  fprintf(stderr, "0x%04X-0x%04X: %u bytes in %.2f s (%.0f bytes/s), %lu bad blocks, %u bytes missing\n",
+          (unsigned)img.base, (unsigned)(img.base + img.len - 1), (unsigned)img.len, dt,
+          dt > 0 ? img.len / dt : 0.0, img.badBlocks, (unsigned)missing);
+
+  if (outPath) {
+    FILE *fp = fopen(outPath, "wb");
+    if (!fp || fwrite(img.data, 1, img.len, fp) != img.len || fclose(fp) != 0) {
+      perror(outPath);
+      return 1;
+    }
+  } else if (!refPath) {
+    hexDump(&img);
+  }
+  if (refPath) {
+    long diffs = diffImage(&img, refPath);
+    if (diffs == 0) {
+      printf("identical\n");
+    } else if (diffs < 0) {
+      return 1;
+    }
+  }
+  return missing ? 1 : 0;
+}
@@ -0,0 +1,296 @@
+/*
+    namasteProto.c
+    Helpers shared by the Namaste host tools
+*/
+
+#include "namasteProto.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+
+/* *** byte order helpers *** */
+
+uint16_t get16le(const unsigned char *buf) {
+  return (uint16_t)(buf[0] | (buf[1] << 8));
+}
+
+uint32_t get32le(const unsigned char *buf) {
+  return ((uint32_t)buf[0]) | ((uint32_t)buf[1] << 8) |
+         ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+void put16le(unsigned char *buf, uint16_t val) {
+  buf[0] = (unsigned char)val;
+  buf[1] = (unsigned char)(val >> 8);
+}
+
+void put32le(unsigned char *buf, uint32_t val) {
+  unsigned char i;
+  for (i = 0; i < 4; i++) {
+    buf[i] = (unsigned char)val;        /* low byte first, same as send32bit() */
+    val >>= 8;
+  }
+}
+
+/* *** time helpers *** */
+
+// monotonic clock in seconds, for pacing and throughput
+double monoSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// wall clock in seconds from epoch, for timestamps sent to the device
+double wallSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// time on the wire for one UART byte, 0 when unpaced
+double byteSeconds(unsigned long baud) {
+  return baud ? (double)UART_FRAME_BITS / baud : 0.0;
+}
+
+/* *** tty helpers *** */
+
+static speed_t baudToSpeed(unsigned long baud) {
+  switch (baud) {
+  case 1200:    return B1200;
+  case 2400:    return B2400;
+  case 4800:    return B4800;
+  case 9600:    return B9600;
+  case 19200:   return B19200;
+  case 38400:   return B38400;
+  case 57600:   return B57600;
+  case 115200:  return B115200;
+  case 230400:  return B230400;
+  default:      return B0;
+  }
+}
+
+// put a tty (serial port or pty) into raw 8N1 mode
+int setRawMode(int fd, unsigned long baud) {
+  struct termios tio;
+  speed_t speed = baudToSpeed(baud);
+
+  if (tcgetattr(fd, &tio) < 0) {
+    return -1;
+  }
+  cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+  if (speed != B0) {
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+  } else if (baud != 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  return tcsetattr(fd, TCSANOW, &tio);
+}
+
+/* *** framed messages *** */
+
+/* decoder states */
+#define FRAME_WAIT_SOF  0
+#define FRAME_WAIT_TYPE 1
+#define FRAME_WAIT_LEN  2
+#define FRAME_PAYLOAD   3
+#define FRAME_WAIT_SUM  4
+#define FRAME_WAIT_SUM_HI   5       /* bootloader frames only, second CRC byte */
+
+// encode a frame the same way sendFrame() in the firmware does, returns its size
+size_t frameEncode(unsigned char *buf, unsigned char type, const unsigned char *payload, unsigned char len) {
+  unsigned char sum = (unsigned char)(type + len);
+  size_t n = 0;
+  unsigned char i;
+
+  buf[n++] = FRAME_SOF;
+  buf[n++] = type;
+  buf[n++] = len;
+  for (i = 0; i < len; i++) {
+    sum = (unsigned char)(sum + payload[i]);
+    buf[n++] = payload[i];
+  }
+  buf[n++] = (unsigned char)(-sum);
+  return n;
+}
+
+void frameReset(struct frameDecoder *dec) {
+  dec->state = FRAME_WAIT_SOF;
+}
+
+// feed one byte, returns 1 when a valid frame is complete, -1 on a bad frame, 0 otherwise
+int frameFeed(struct frameDecoder *dec, unsigned char c) {
+  switch (dec->state) {
+  case FRAME_WAIT_SOF:
+    if (c == FRAME_SOF) {
+      dec->state = FRAME_WAIT_TYPE;
+    }
+    return 0;
+  case FRAME_WAIT_TYPE:
+    dec->type = c;
+    dec->sum = c;
+    dec->state = FRAME_WAIT_LEN;
+    return 0;
+  case FRAME_WAIT_LEN:
+    if (c > FRAME_MAX_PAYLOAD) {
+      dec->state = FRAME_WAIT_SOF;
+      return -1;
+    }
+    dec->len = c;
+    dec->pos = 0;
+    dec->sum = (unsigned char)(dec->sum + c);
+    dec->state = c ? FRAME_PAYLOAD : FRAME_WAIT_SUM;
+    return 0;
+  case FRAME_PAYLOAD:
+    dec->payload[dec->pos++] = c;
+    dec->sum = (unsigned char)(dec->sum + c);
+    if (dec->pos == dec->len) {
+      dec->state = FRAME_WAIT_SUM;
+    }
+    return 0;
+  default:
+    dec->state = FRAME_WAIT_SOF;
+    return ((unsigned char)(dec->sum + c) == 0) ? 1 : -1;
+  }
+}
+
+/* *** CRC *** */
+
+// same bitwise CRC-16-CCITT as crc16Update() in the firmware
+uint16_t crc16Update(uint16_t crc, unsigned char value) {
+  unsigned char i;
+  crc ^= (uint16_t)(value << 8);
+  for (i = 0; i < 8; i++) {
+    crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+  }
+  return crc;
+}
+
+uint16_t crc16(uint16_t crc, const unsigned char *buf, size_t len) {
+  while (len--) {
+    crc = crc16Update(crc, *buf++);
+  }
+  return crc;
+}
+
+/* *** bootloader frames *** */
+
+// encode a bootloader frame, returns its size
+size_t bootFrameEncode(unsigned char *buf, unsigned char type, const unsigned char *payload, unsigned char len) {
+  uint16_t crc;
+  size_t n = 0;
+
+  buf[n++] = FRAME_SOF;
+  buf[n++] = type;
+  buf[n++] = len;
+  memcpy(buf + n, payload, len);
+  n += len;
+  crc = crc16(CRC16_INIT, buf + 1, n - 1);
+  put16le(buf + n, crc);
+  return n + 2;
+}
+
+void bootFrameReset(struct bootDecoder *dec) {
+  dec->state = FRAME_WAIT_SOF;
+}
+
+// feed one byte, returns 1 when a valid frame is complete, -1 on a bad frame, 0 otherwise
+int bootFrameFeed(struct bootDecoder *dec, unsigned char c) {
+  switch (dec->state) {
+  case FRAME_WAIT_SOF:
+    if (c == FRAME_SOF) {
+      dec->state = FRAME_WAIT_TYPE;
+    }
+    return 0;
+  case FRAME_WAIT_TYPE:
+    dec->type = c;
+    dec->crc = crc16Update(CRC16_INIT, c);
+    dec->state = FRAME_WAIT_LEN;
+    return 0;
+  case FRAME_WAIT_LEN:
+    if (c > BOOT_MAX_PAYLOAD) {
+      dec->state = FRAME_WAIT_SOF;
+      return -1;
+    }
+    dec->len = c;
+    dec->pos = 0;
+    dec->crc = crc16Update(dec->crc, c);
+    dec->state = c ? FRAME_PAYLOAD : FRAME_WAIT_SUM;
+    return 0;
+  case FRAME_PAYLOAD:
+    dec->payload[dec->pos++] = c;
+    dec->crc = crc16Update(dec->crc, c);
+    if (dec->pos == dec->len) {
+      dec->state = FRAME_WAIT_SUM;
+    }
+    return 0;
+  case FRAME_WAIT_SUM:
+    dec->crc ^= c;                    /* low-order byte of the CRC */
+    dec->state = FRAME_WAIT_SUM_HI;
+    return 0;
+  default:
+    dec->state = FRAME_WAIT_SOF;
+    return ((dec->crc ^ (uint16_t)(c << 8)) == 0) ? 1 : -1;
+  }
+}
+
+/* *** log files *** */
+
+// load a raw log file into a newly allocated record array
+int loadLog(const char *path, uint32_t **records, size_t *count) {
+  FILE *fp = fopen(path, "rb");
+  unsigned char buf[TIMESTAMP_BYTES];
+  size_t cap = 0;
+  uint32_t *recs = NULL;
+
+  if (!fp) {
+    return -1;
+  }
+  *count = 0;
+  while (fread(buf, 1, TIMESTAMP_BYTES, fp) == TIMESTAMP_BYTES) {
+    if (*count == cap) {
+      uint32_t *grown;
+      cap = cap ? cap * 2 : 1024;
+      grown = realloc(recs, cap * sizeof(*recs));
+      if (!grown) {
+        free(recs);
+        fclose(fp);
+        return -1;
+      }
+      recs = grown;
+    }
+    recs[(*count)++] = get32le(buf);
+  }
+  fclose(fp);
+  *records = recs;
+  return 0;
+}
+
+// write records in the same raw format read by loadLog()
+int saveLog(const char *path, const uint32_t *records, size_t count) {
+  FILE *fp = fopen(path, "wb");
+  unsigned char buf[TIMESTAMP_BYTES];
+  size_t i;
+
+  if (!fp) {
+    return -1;
+  }
+  for (i = 0; i < count; i++) {
+    put32le(buf, records[i]);
+    if (fwrite(buf, 1, TIMESTAMP_BYTES, fp) != TIMESTAMP_BYTES) {
+      fclose(fp);
+      return -1;
+    }
+  }
+  return fclose(fp);
+}
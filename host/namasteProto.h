@@ -0,0 +1,206 @@
+/*
+    namasteProto.h
+    Host-side definitions of the Namaste UART protocol
+
+    Values here mirror the #defines in namasteTrunk/main.c and must be kept
+    in sync with the firmware.
+*/
+
+#ifndef NAMASTE_PROTO_H
+#define NAMASTE_PROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* command bytes (see USCI0RX_ISR) */
+#define CMD_QUIT        'q'     /* device ACKs, then takes a 4-byte timestamp and leaves UART mode */
+#define CMD_QUIT_PHASED 'Q'     /* as 'q', with a 2-byte sub-second phase for the instant 'Q' arrived */
+#define CMD_RESET       'r'     /* erase all timestamps, device ACKs */
+#define CMD_DOWNLOAD    'd'     /* device sends number of timestamps (2 bytes) */
+#define CMD_NEXT        'e'     /* device sends next timestamp (4 bytes) */
+#define CMD_CLOCK       't'     /* device sends curTimestamp (4), sub-second phase (2), ticks per second (2), time last set (4 + 2) */
+#define CMD_PING        'p'     /* device sends its clock at receive (4 + 2) and the phase at reply (2) */
+#define CMD_STREAM      'l'     /* device ACKs, takes a 4-byte timestamp and streams framed events */
+#define CMD_STREAM_STOP 'x'     /* (streaming only) device ACKs and waits for more commands */
+#define CMD_BOOTLOADER  'B'     /* device ACKs, then resets into the UART bootloader */
+#define CMD_GET_CONFIG  'g'     /* device sends its sensing parameters (CONFIG_BYTES) */
+#define CMD_SET_CONFIG  'c'     /* followed by CONFIG_BYTES, device ACKs if valid and saved, NAKs otherwise or for a new storage mode while it holds records */
+#define CMD_FILTERED    'n'     /* device sends the number of mat state changes its event filter dropped (2 bytes) */
+#define CMD_SUMMARY     'u'     /* device sends its log summary as one FRAME_SUMMARY frame */
+#define CMD_RANGE       'f'     /* followed by first and last timestamp (4 each), device sends the number of records in between (2 bytes), 'e' walks them */
+#define CMD_ADC         'a'     /* device sends one ADC10 reading of the sensor (2 bytes) */
+#define CMD_BAUD        'b'     /* followed by a baud code, device ACKs at the old rate and switches, NAKs an unknown code */
+
+/* communications constants */
+#define ACK_VALUE       '!'
+#define NAK_VALUE       '?'
+#define NAMASTE_BAUD    9600
+#define NAMASTE_FAST_BAUD   115200  /* after 'b' BAUD_CODE_115200, until the time is set or the cable is pulled */
+#define BAUD_CODE_9600      0       /* clock levels of the firmware, DCO 1 MHz */
+#define BAUD_CODE_115200    1       /* DCO 8 MHz */
+#define UART_FRAME_BITS 10      /* start + 8 data + stop */
+
+/* framed messages: SOF, type, length, payload, checksum (type..checksum sums to 0) */
+#define FRAME_SOF       0x7E
+#define FRAME_EVENT     'E'     /* payload: 32-bit record */
+#define FRAME_HEARTBEAT 'H'     /* payload: 32-bit curTimestamp */
+#define FRAME_SUMMARY   'U'     /* payload: SUMMARY_BYTES */
+#define FRAME_OVERHEAD  4
+#define FRAME_MAX_PAYLOAD   32
+
+/* log summary ('u'): events recorded (2), first and last event time (4 each),
+ * occupied seconds (4), records that found the storage full (2), changes the
+ * event filter dropped (2), all since the last 'r' */
+#define SUMMARY_BYTES   18
+
+/* sensing parameters ('g' and 'c'): version, sense period in seconds,
+ * 200 ms cycles the cable must be in before UART mode, 1 s cycles it must be out
+ * before SENSE mode, samples a new mat state needs in a row, further samples it
+ * must last before it is recorded, storage mode, occupancy bucket length in hours,
+ * number of sensor channels (read only), sense mode, closed and open thresholds
+ * of analog sensing (2 each) */
+#define CONFIG_BYTES        14
+#define CONFIG_VERSION      5
+#define CONFIG_SENSE_MAX    48      /* longest sense period the device accepts */
+#define CONFIG_DEFAULT_SENSE        15
+#define CONFIG_DEFAULT_WAIT_HIGH    2
+#define CONFIG_DEFAULT_DONE_LOW     2
+#define CONFIG_DEFAULT_CONFIRM      1
+#define CONFIG_DEFAULT_DWELL        0
+#define CONFIG_DEFAULT_STORAGE      STORE_EDGES
+#define CONFIG_DEFAULT_BUCKET_HOURS 1
+#define CONFIG_BUCKET_HOURS_MAX     24
+#define CONFIG_DEFAULT_SENSE_MODE   SENSE_DIGITAL
+#define CONFIG_DEFAULT_CLOSED       341
+#define CONFIG_DEFAULT_OPEN         682
+
+/* sense modes */
+#define SENSE_DIGITAL       0       /* sensor read as a digital input */
+#define SENSE_ANALOG        1       /* sensor converted with ADC10 and compared against the thresholds */
+#define ADC_MAX             1023
+#define ADC_BYTES           2       /* 'a' reply */
+
+/* storage modes */
+#define STORE_EDGES         0       /* one record per mat state change */
+#define STORE_OCCUPANCY     1       /* one record per bucket with its number of occupied (closed) samples */
+#define STORE_COUNTS        2       /* one record per bucket with its number of presses, counted in hardware */
+
+/* timing constants */
+#define DOCK_STABLE_MS  400     /* PCCOMM must be high this long before the device enters UART mode */
+
+/* record format */
+#define TIMESTAMP_BYTES 4           /* 31-bit UNIX timestamp (integer seconds from epoch) */
+#define TIMESTAMP_MASK  0x7FFFFFFFUL
+#define MAT_STATE_SHIFT 31
+#define CHANNEL_SHIFT   28          /* devices with several channels: channel in bits 30..28 */
+#define CHANNEL_TIME_MASK   0x0FFFFFFFUL    /* ... and only the low 28 bits of the timestamp */
+#define MAX_CHANNELS    8
+#define MAT_OPEN        1
+#define MAT_CLOSED      0
+#define COUNT_BYTES     2           /* 'd' reply is a 16-bit count */
+#define CLOCK_BYTES     14          /* 't' reply */
+#define CLOCK_BYTES_OLD 8           /* 't' reply of firmware that does not send the time last set */
+#define PING_BYTES      8           /* 'p' reply */
+#define PHASED_TIME_BYTES   6       /* 'Q' time: timestamp, then sub-second phase */
+#define MAX_RECORDS     0xFFFF
+
+/* occupancy and count records: base records hold a bucket start with the high bit set,
+ * bucket records their offset from the last base (in buckets) and occupied samples or presses */
+#define BASE_RECORD_FLAG    0x80000000UL
+#define BUCKET_COUNT_MAX    0xFFFF
+
+/* macros */
+#define isBaseRecord(rec)   (((rec) & BASE_RECORD_FLAG) != 0)
+#define bucketOffset(rec)   ((uint16_t)((rec) >> 16))
+#define bucketCount(rec)    ((uint16_t)(rec))
+#define recordState(rec)    ((unsigned char)((rec) >> MAT_STATE_SHIFT))
+#define recordTime(rec)     ((uint32_t)((rec) & TIMESTAMP_MASK))
+#define makeRecord(st, ts)  ((((uint32_t)(st)) << MAT_STATE_SHIFT) | ((uint32_t)(ts) & TIMESTAMP_MASK))
+#define recordChannel(rec)  ((unsigned char)(((rec) >> CHANNEL_SHIFT) & (MAX_CHANNELS - 1)))
+/* full time of a multi-channel record: the latest time up to now that ends in its 28 bits */
+#define channelRecordTime(rec, now) ((uint32_t)((now) - (((uint32_t)(now) - (rec)) & CHANNEL_TIME_MASK)))
+
+/* frame decoder, fed one received byte at a time */
+struct frameDecoder {
+  unsigned char state;
+  unsigned char type;
+  unsigned char len;
+  unsigned char pos;
+  unsigned char sum;
+  unsigned char payload[FRAME_MAX_PAYLOAD];
+};
+
+/* byte order helpers (all multi-byte values are sent low-order byte first) */
+uint16_t get16le(const unsigned char *buf);
+uint32_t get32le(const unsigned char *buf);
+void put16le(unsigned char *buf, uint16_t val);
+void put32le(unsigned char *buf, uint32_t val);
+
+/* time helpers */
+double monoSeconds(void);
+double wallSeconds(void);
+double byteSeconds(unsigned long baud);
+
+/* tty helpers */
+int setRawMode(int fd, unsigned long baud);
+
+/* framed messages */
+size_t frameEncode(unsigned char *buf, unsigned char type, const unsigned char *payload, unsigned char len);
+void frameReset(struct frameDecoder *dec);
+int frameFeed(struct frameDecoder *dec, unsigned char c);
+
+/* CRC-16-CCITT (poly 0x1021, init 0xFFFF), as used by the memory dump service and the bootloader */
+#define CRC16_INIT      0xFFFF
+uint16_t crc16Update(uint16_t crc, unsigned char value);
+uint16_t crc16(uint16_t crc, const unsigned char *buf, size_t len);
+
+/* bootloader frames (see BOOT/uartBoot/main.c): SOF, type, length, payload,
+ * CRC-16 over type, length and payload. Replies carry the request type and a
+ * status byte in front of their payload. */
+#define BOOT_SYNC       'S'     /* reply: version, block size, application area start and end */
+#define BOOT_BAUD       'B'     /* payload: baud code; reply at the old rate, then switch */
+#define BOOT_ERASE      'E'     /* payload: segment address */
+#define BOOT_WRITE      'W'     /* payload: address, up to BOOT_BLOCK_SIZE bytes within one flash row */
+#define BOOT_CRC        'C'     /* payload: address, length; reply: CRC-16 of the range */
+#define BOOT_GO         'G'     /* start the application */
+#define BOOT_BAD_FRAME  '?'     /* reply type for a frame that failed its CRC */
+
+#define BOOT_OK             0
+#define BOOT_ERR_FRAME      1
+#define BOOT_ERR_ADDRESS    2
+#define BOOT_ERR_VERIFY     3
+#define BOOT_ERR_COMMAND    4
+#define BOOT_ERR_NO_APP     5
+
+#define BOOT_BAUD_9600      0
+#define BOOT_BAUD_115200    1
+
+#define BOOT_BLOCK_SIZE     64          /* flash row */
+#define BOOT_SEGMENT_SIZE   512         /* flash erase unit */
+#define BOOT_APP_START      0x8000
+#define BOOT_APP_END        0xF800      /* first address after the application area */
+#define BOOT_APP_VECTORS    0xF7E0      /* proxy vector table the bootloader jumps through */
+#define BOOT_HW_VECTORS     0xFFE0
+#define BOOT_FRAME_OVERHEAD 5
+#define BOOT_MAX_PAYLOAD    (2 + BOOT_BLOCK_SIZE)
+#define BOOT_WAIT_MS        1000        /* bootloader starts the application if not synced by then */
+
+/* bootloader frame decoder, fed one received byte at a time */
+struct bootDecoder {
+  unsigned char state;
+  unsigned char type;
+  unsigned char len;
+  unsigned char pos;
+  uint16_t crc;
+  unsigned char payload[BOOT_MAX_PAYLOAD];
+};
+
+size_t bootFrameEncode(unsigned char *buf, unsigned char type, const unsigned char *payload, unsigned char len);
+void bootFrameReset(struct bootDecoder *dec);
+int bootFrameFeed(struct bootDecoder *dec, unsigned char c);
+
+/* log files (raw little-endian 4-byte records, as returned by 'e') */
+int loadLog(const char *path, uint32_t **records, size_t *count);
+int saveLog(const char *path, const uint32_t *records, size_t count);
+
+#endif
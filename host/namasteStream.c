@@ -0,0 +1,192 @@
+/*
+    namasteStream.c
+    Live view of mat events while a board is docked
+
+    Sets the device time with 'l' instead of 'q', which keeps the board in
+    STREAM mode: every new event is pushed as a framed message and a heartbeat
+    carrying curTimestamp arrives every sense tick. Ctrl-C sends 'x' so the
+    board goes back to waiting for commands.
+
+    The sensing parameters are read with 'g' first: on boards with several
+    sensor channels every event carries its channel and only the low 28 bits
+    of its time, which is completed from the latest device time seen.
+
+    Build:  gcc -Wall -O2 -o namasteStream namasteStream.c namasteProto.c
+    Usage:  namasteStream /dev/ttyUSB0
+*/
+
+#define _GNU_SOURCE
+#include "namasteProto.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define REPLY_TIMEOUT_MS    1000
+
+static volatile sig_atomic_t quitting;
+static unsigned char channels = 1;      /* from 'g' */
+static uint32_t deviceNow;              /* time sent with 'l', then the latest heartbeat */
+
+static void onSignal(int sig) {
+  (void)sig;
+  quitting = 1;
+}
+
+// wait for a single ACK byte
+static int waitAck(int fd) {
+  struct pollfd pfd;
+  unsigned char c;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  while (poll(&pfd, 1, REPLY_TIMEOUT_MS) > 0) {
+    if (read(fd, &c, 1) == 1) {
+      return (c == ACK_VALUE) ? 0 : -1;
+    }
+  }
+  return -1;
+}
+
+// read the sensing parameters and keep the channel count, -1 if they do not arrive
+static int getChannels(int fd) {
+  unsigned char cmd = CMD_GET_CONFIG;
+  unsigned char cfg[CONFIG_BYTES];
+  struct pollfd pfd;
+  size_t got = 0;
+
+  if (write(fd, &cmd, 1) != 1) {
+    return -1;
+  }
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  while (got < sizeof(cfg)) {
+    ssize_t n;
+    if (poll(&pfd, 1, REPLY_TIMEOUT_MS) <= 0) {
+      return -1;
+    }
+    n = read(fd, cfg + got, sizeof(cfg) - got);
+    if (n > 0) {
+      got += (size_t)n;
+    }
+  }
+  if (cfg[0] != CONFIG_VERSION || cfg[8] == 0 || cfg[8] > MAX_CHANNELS) {
+    return -1;
+  }
+  channels = cfg[8];
+  return 0;
+}
+
+static void printTime(uint32_t ts) {
+  time_t t = (time_t)ts;
+  char buf[32];
+  strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&t));
+  fputs(buf, stdout);
+}
+
+static void handleFrame(const struct frameDecoder *dec) {
+  uint32_t val;
+
+  if (dec->len != TIMESTAMP_BYTES) {
+    return;
+  }
+  val = get32le(dec->payload);
+  if (dec->type == FRAME_EVENT && channels > 1) {
+    /* an event can be a sense period newer than the last heartbeat */
+    printTime(channelRecordTime(val, deviceNow + CONFIG_SENSE_MAX));
+    printf("  %u %s\n", recordChannel(val), (recordState(val) == MAT_OPEN) ? "open" : "closed");
+  } else if (dec->type == FRAME_EVENT) {
+    printTime(recordTime(val));
+    printf("  %s\n", (recordState(val) == MAT_OPEN) ? "open" : "closed");
+  } else if (dec->type == FRAME_HEARTBEAT) {
+    deviceNow = val;
+    printTime(val);
+    printf("  heartbeat (device - host = %+.0f s)\n", (double)val - wallSeconds());
+  }
+  fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+  struct frameDecoder dec;
+  unsigned char cmd = CMD_STREAM;
+  unsigned char ts[TIMESTAMP_BYTES];
+  struct timespec dockWait = { 0, (DOCK_STABLE_MS + 100) * 1000000L };
+  int fd;
+
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s PORT\n", argv[0]);
+    return 2;
+  }
+  fd = open(argv[1], O_RDWR | O_NOCTTY);
+  if (fd < 0 || setRawMode(fd, NAMASTE_BAUD) < 0) {
+    perror(argv[1]);
+    return 1;
+  }
+  nanosleep(&dockWait, NULL);         /* device needs the cable stable before UART mode */
+  tcflush(fd, TCIFLUSH);
+
+  if (getChannels(fd) < 0) {
+    fprintf(stderr, "no sensing parameters ('%c')\n", CMD_GET_CONFIG);
+    return 1;
+  }
+  if (write(fd, &cmd, 1) != 1 || waitAck(fd) < 0) {
+    fprintf(stderr, "no ACK for stream request\n");
+    return 1;
+  }
+  deviceNow = (uint32_t)wallSeconds();
+  put32le(ts, deviceNow);
+  if (write(fd, ts, sizeof(ts)) != sizeof(ts)) {
+    perror("write");
+    return 1;
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  frameReset(&dec);
+  while (!quitting) {
+    unsigned char buf[64];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    ssize_t i;
+
+    if (n < 0 && errno != EINTR && errno != EAGAIN) {
+      perror("read");
+      break;
+    }
+    for (i = 0; i < n; i++) {
+      int ret = frameFeed(&dec, buf[i]);
+      if (ret > 0) {
+        handleFrame(&dec);
+      } else if (ret < 0) {
+        fprintf(stderr, "bad frame\n");
+      }
+    }
+    if (n == 0) {
+      struct timespec idle = { 0, 20000000L };
+      nanosleep(&idle, NULL);
+    }
+  }
+
+  cmd = CMD_STREAM_STOP;
+  tcflush(fd, TCIFLUSH);
+  if (write(fd, &cmd, 1) == 1) {
+    /* an event frame may still be on its way, so skip to the ACK */
+    struct pollfd pfd;
+    unsigned char c = 0;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while (c != ACK_VALUE && poll(&pfd, 1, REPLY_TIMEOUT_MS) > 0 && read(fd, &c, 1) == 1) {
+    }
+    if (c != ACK_VALUE) {
+      fprintf(stderr, "no ACK for stream stop\n");
+    }
+  }
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,244 @@
+/*
+    schedTest.c
+    Host test of the timer A scheduler (namasteTrunk/sched.c)
+
+    Stands in for schedHw.h with plain variables by the timer A register
+    names and includes sched.c, then runs timer A one tick at a time: TAR
+    counts up, a match sets CCIFG, the wrap sets TAIFG, and pending flags are
+    handed to the ISRs in the priority of the device, through TAIV for CCR1,
+    CCR2 and the wrap. Checks that deadlines fire in order and at their tick,
+    that a deadline set in the past fires at once instead of after a wrap,
+    and that the wraps carry into schedNow(), also while TAIFG is pending.
+
+    Build:  gcc -Wall -O2 -o schedTest schedTest.c
+    Usage:  schedTest, exits 1 if a check fails
+*/
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/* timer A of the MSP430F2274, in place of schedHw.h */
+#define SCHED_HW_H
+
+static unsigned short TACTL, TAR, TAIV;
+static unsigned short CCR0, CCR1, CCR2;
+static unsigned short CCTL0, CCTL1, CCTL2;
+
+#define TASSEL_1        0x0100
+#define ID_0            0x0000
+#define ID_1            0x0040
+#define ID_2            0x0080
+#define ID_3            0x00C0
+#define MC_2            0x0020
+#define TACLR           0x0004
+#define TAIE            0x0002
+#define TAIFG           0x0001
+#define CCIE            0x0010
+#define CCIFG           0x0001
+#define TAIV_TACCR1     2
+#define TAIV_TACCR2     4
+#define TAIV_TAIFG      10
+
+static int wakes;                   /* SCHED_WAKE() calls */
+
+#define SCHED_ISR(vec, name)    void name(void)
+#define SCHED_WAKE()            (wakes++)
+
+#include "../namasteTrunk/sched.c"
+
+static volatile unsigned short * const ccr[SCHED_TIMERS] = { &CCR0, &CCR1, &CCR2 };
+static volatile unsigned short * const cctl[SCHED_TIMERS] = { &CCTL0, &CCTL1, &CCTL2 };
+
+static int failures;
+
+#define CHECK(cond) do { \
+          if (!(cond)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+          } \
+        } while (0)
+
+/* what the handlers saw */
+#define MAX_FIRES   16
+static struct {
+  unsigned char timer;
+  unsigned long now;
+} fires[MAX_FIRES];
+static int fireCount;
+
+static unsigned long period;        /* re-arm period of timer 1, 0 for one shot */
+static unsigned short handlerTicks; /* ticks the next run of timer 1's handler takes */
+
+static void record(unsigned char timer) {
+  if (fireCount < MAX_FIRES) {
+    fires[fireCount].timer = timer;
+    fires[fireCount].now = schedNow();
+  }
+  fireCount++;
+}
+
+static bool fire0(void) {
+  record(0);
+  return true;
+}
+
+static bool fire1(void) {
+  record(1);
+  TAR += handlerTicks;              /* a slow run, without matches or wraps */
+  handlerTicks = 0;
+  if (period) {
+    schedAt(1, schedDeadline(1) + period, fire1);
+  }
+  return false;
+}
+
+static bool fire2(void) {
+  record(2);
+  return true;
+}
+
+// TACLR of the last TACTL write clears TAR and is not kept
+static void clearTimer(void) {
+  if (TACTL & TACLR) {
+    TAR = 0;
+    TACTL &= ~TACLR;
+  }
+}
+
+// timer A from 0 with every timer off
+static void start(void) {
+  schedStop();
+  schedStart();
+  clearTimer();
+  fireCount = 0;
+  wakes = 0;
+  period = 0;
+  handlerTicks = 0;
+}
+
+// run the interrupts that are enabled and pending, highest priority first
+static void service(void) {
+  while (true) {
+    if ((CCTL0 & (CCIE | CCIFG)) == (CCIE | CCIFG)) {
+      CCTL0 &= ~CCIFG;              /* cleared when the CCR0 vector is taken */
+      schedCcr0Isr();
+    } else {
+      if ((CCTL1 & (CCIE | CCIFG)) == (CCIE | CCIFG)) {
+        CCTL1 &= ~CCIFG;            /* cleared by the read of TAIV */
+        TAIV = TAIV_TACCR1;
+      } else if ((CCTL2 & (CCIE | CCIFG)) == (CCIE | CCIFG)) {
+        CCTL2 &= ~CCIFG;
+        TAIV = TAIV_TACCR2;
+      } else if ((TACTL & (TAIE | TAIFG)) == (TAIE | TAIFG)) {
+        TACTL &= ~TAIFG;
+        TAIV = TAIV_TAIFG;
+      } else {
+        return;
+      }
+      schedTimerAIsr();
+    }
+  }
+}
+
+// one timer A tick without running the interrupts
+static void count(void) {
+  unsigned char timer;
+  if (!(TACTL & MC_2)) {
+    return;
+  }
+  TAR++;
+  if (TAR == 0) {
+    TACTL |= TAIFG;
+  }
+  for (timer = 0; timer < SCHED_TIMERS; timer++) {
+    if (TAR == *ccr[timer]) {
+      *cctl[timer] |= CCIFG;
+    }
+  }
+}
+
+static void run(unsigned long ticks) {
+  while (ticks--) {
+    count();
+    service();
+  }
+}
+
+// three deadlines set out of order, one past the first wrap, fire in time order
+// and each at its own tick
+static void testOrder(void) {
+  start();
+  schedAt(0, 1000, fire0);
+  schedAt(1, 300, fire1);
+  schedAt(2, 0x10000UL + 500, fire2);   /* CCR2 matches 500 before the wrap too */
+  run(0x20000UL);
+  CHECK(fireCount == 3);
+  CHECK(fires[0].timer == 1 && fires[0].now == 300);
+  CHECK(fires[1].timer == 0 && fires[1].now == 1000);
+  CHECK(fires[2].timer == 2 && fires[2].now == 0x10000UL + 500);
+  CHECK(wakes == 2);                    /* fire1 stays in the low power mode */
+  CHECK(!((CCTL0 | CCTL1 | CCTL2) & CCIE));   /* CCIFG still follows the matches */
+  schedStop();
+}
+
+// a deadline already passed fires at the next service instead of at the match
+// after the wrap, including a periodic timer whose handler overran its period
+static void testCatchUp(void) {
+  start();
+  run(2000);
+  schedAt(0, 1500, fire0);
+  service();
+  CHECK(fireCount == 1 && fires[0].timer == 0 && fires[0].now == 2000);
+
+  start();
+  period = 100;
+  handlerTicks = 250;                   /* the first run takes two and a half periods */
+  schedAt(1, 100, fire1);
+  run(100);
+  CHECK(fireCount == 3);                /* the missed deadlines at 200 and 300 fire back to back */
+  CHECK(fires[0].now == 100 && fires[1].now == 350 && fires[2].now == 350);
+  CHECK(schedDeadline(1) == 400);       /* still on the grid of the first deadline */
+  run(100);
+  CHECK(fireCount == 4 && fires[3].now == 400);
+  period = 0;
+  schedCancel(1);
+  schedStop();
+}
+
+// the wraps count into the high word, and a wrap whose TAIFG is still pending
+// is already counted by schedNow()
+static void testRollover(void) {
+  unsigned long ticks;
+  start();
+  for (ticks = 1; ticks <= 3 * 0x10000UL + 10; ticks++) {
+    run(1);
+    if (schedNow() != ticks) {
+      CHECK(schedNow() == ticks);
+      break;
+    }
+  }
+
+  start();
+  TAR = 0xFFFE;
+  count();
+  CHECK(schedNow() == 0xFFFF);
+  count();                              /* wraps, the ISR has not run yet */
+  CHECK((TACTL & TAIFG) && schedNow() == 0x10000UL);
+  count();
+  CHECK(schedNow() == 0x10001UL);
+  service();
+  CHECK(!(TACTL & TAIFG) && schedNow() == 0x10001UL);
+  schedStop();
+}
+
+int main(void) {
+  testOrder();
+  testCatchUp();
+  testRollover();
+  if (failures) {
+    printf("%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all scheduler checks passed\n");
+  return 0;
+}
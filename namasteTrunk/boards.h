@@ -0,0 +1,155 @@
+/*
+    boards.h
+    Board profiles for the Namaste firmware
+
+    Every board runs the same main.c and sched.c. A profile declares what
+    differs between the boards: the chip's timer B and port 4, the pins, the
+    ACLK oscillators and the timer divider, the default sense period and the
+    UART baud rates. The project selects a profile with BOARD in its
+    preprocessor defines (namasteRC.ewp sets BOARD=BOARD_NAMASTE_REV3),
+    without one the firmware builds for the AMBER board.
+
+    The Namaste Rev 3 board has an MSP430F2132, without timer B or port 4.
+    The settle waits and the crystal checks then run on Timer1_A2, and
+    STORE_COUNTS, which counts on TBCLK, is not available. namasteRC.ewp
+    links with namasteRC/lnk430F2132_namaste.xcl, which puts the
+    FLASH_TIMESTAMP_STORAGE segment in the first 512 bytes of flash.
+
+    Timer periods and UART dividers are derived from the profile with
+    preprocessor arithmetic, so they cost nothing at run time, and a profile
+    whose values do not fit the registers fails to build.
+*/
+
+#ifndef BOARDS_H
+#define BOARDS_H
+
+#define BOARD_AMBER         1       /* AMBER board, ACLK from the VLO */
+#define BOARD_AMBER_XT1     2       /* AMBER board with the 32768 Hz crystal fitted */
+#define BOARD_NAMASTE_REV3  3       /* Namaste Rev 3 (MSP430F2132), 32768 Hz crystal, extra debug pins and an LED */
+
+#ifndef BOARD
+#define BOARD   BOARD_AMBER
+#endif
+
+#if BOARD == BOARD_AMBER || BOARD == BOARD_AMBER_XT1
+
+/* MSP430F2274 */
+#define BOARD_HAS_TIMERB    1
+#define BOARD_HAS_PORT4     1
+
+/* pin definitions */
+#define DBG0    BIT0    /* P1.0 - debug pin 0 */
+#define SENVCC  BIT0    /* P2.0 - switch circuit power */
+#define SENSEIN BIT1    /* P2.1 - sensor input voltage signal */
+#define SENSEIN_INCH    INCH_1  /* SENSEIN is ADC10 input A1 */
+#define PCCOMM  BIT2    /* P2.2 - high indicates that the serial communications cable is plugged in */
+#define XIN     BIT6    /* P2.6 - XIN for external crystal oscillator (ACLK_XT1) */
+#define XOUT    BIT7    /* P2.7 - XOUT for external crystal oscillator (ACLK_XT1) */
+#define UARTRX  BIT4    /* P3.4 - UART RX Pin */
+#define UARTTX  BIT5    /* P3.5 - UART TX Pin */
+#define COUNTIN BIT7    /* P4.7 - TBCLK, sensor output for STORE_COUNTS (wired in parallel with SENSEIN) */
+#define P1_SPARE_OUTS   0       /* outputs the firmware does not use, driven low */
+#define P3_SPARE_OUTS   0
+
+/* sensor channels, see main.c */
+#define SENSE_P1_PINS   0
+#define SENSE_P2_PINS   SENSEIN
+#define SENSE_P4_PINS   0
+
+/* ACLK source: 0 runs ACLK from the VLO, 1 from a crystal on XIN/XOUT that is
+ * started in the background while the device runs on the VLO */
+#define ACLK_XT1        (BOARD == BOARD_AMBER_XT1)
+#define XT1_HZ          32768UL
+#define XT1_XCAP        XCAP_3  /* 12.5 pF */
+#define ACLK_DIV        8       /* timer A counts ACLK/8 */
+
+/* periods and baud rates */
+#define SENSE_SECONDS   15      /* default sense period in seconds */
+#define SLOW_BAUD       9600    /* CLOCK_SLOW, docking and sensing */
+#define FAST_BAUD       115200  /* CLOCK_FAST, downloads */
+
+#elif BOARD == BOARD_NAMASTE_REV3
+
+/* MSP430F2132 */
+#define BOARD_HAS_TIMERB    0
+#define BOARD_HAS_PORT4     0
+
+/* pin definitions */
+#define DBG0    BIT0    /* P1.0 - debug pin 0 */
+#define DBG1    BIT1    /* P1.1 - debug pin 1 */
+#define DBG2    BIT4    /* P1.4 - debug pin 2 */
+#define SENVCC  BIT0    /* P2.0 - switch circuit power */
+#define SENSEIN BIT1    /* P2.1 - sensor input voltage signal */
+#define SENSEIN_INCH    INCH_1  /* SENSEIN is ADC10 input A1 */
+#define PCCOMM  BIT2    /* P2.2 - high indicates that the serial communications cable is plugged in */
+#define XIN     BIT6    /* P2.6 - XIN for external crystal oscillator */
+#define XOUT    BIT7    /* P2.7 - XOUT for external crystal oscillator */
+#define UARTRX  BIT4    /* P3.4 - UART RX Pin */
+#define UARTTX  BIT5    /* P3.5 - UART TX Pin */
+#define LED0    BIT6    /* P3.6 - LED indicator light */
+#define P1_SPARE_OUTS   (DBG1 | DBG2)
+#define P3_SPARE_OUTS   LED0
+
+/* sensor channels, see main.c */
+#define SENSE_P1_PINS   0
+#define SENSE_P2_PINS   SENSEIN
+#define SENSE_P4_PINS   0
+
+/* ACLK source */
+#define ACLK_XT1        1
+#define XT1_HZ          32768UL
+#define XT1_XCAP        XCAP_1  /* 6 pF */
+#define ACLK_DIV        8
+
+/* periods and baud rates */
+#define SENSE_SECONDS   15
+#define SLOW_BAUD       9600
+#define FAST_BAUD       115200
+
+#else
+#error "BOARD must be BOARD_AMBER, BOARD_AMBER_XT1 or BOARD_NAMASTE_REV3"
+#endif
+
+#if !BOARD_HAS_PORT4 && SENSE_P4_PINS
+#error "SENSE_P4_PINS on a chip without port 4"
+#endif
+
+/* clocks of the MSP430F2xx, the DCO frequencies are the ones with calibration constants */
+#define VLO_HZ          10922UL
+#define DCO_SLOW_HZ     1000000UL       /* CALBC1_1MHZ, CALDCO_1MHZ */
+#define DCO_FAST_HZ     8000000UL       /* CALBC1_8MHZ, CALDCO_8MHZ */
+
+/* timer A input divider */
+#if ACLK_DIV == 1
+#define ACLK_ID         ID_0
+#elif ACLK_DIV == 2
+#define ACLK_ID         ID_1
+#elif ACLK_DIV == 4
+#define ACLK_ID         ID_2
+#elif ACLK_DIV == 8
+#define ACLK_ID         ID_3
+#else
+#error "ACLK_DIV must be 1, 2, 4 or 8"
+#endif
+
+/* timer A ticks in one second, rounded */
+#define VLO_ACLK_TICKS  ((VLO_HZ + ACLK_DIV / 2) / ACLK_DIV)
+#define XT1_ACLK_TICKS  ((XT1_HZ + ACLK_DIV / 2) / ACLK_DIV)
+#if VLO_ACLK_TICKS > 0xFFFF || XT1_ACLK_TICKS > 0xFFFF
+#error "ACLK_DIV too small, the ticks in one second must fit the 16-bit sub-second phase"
+#endif
+
+/* USCI_A0 low-frequency baud rate generation: clk / baud in eighths, rounded, is UCBRx
+ * in the whole part and UCBRSx in the fraction */
+#define UCBR_EIGHTHS(clk, baud)     (((clk) * 16 / (baud) + 1) / 2)
+#define UCBR(clk, baud)             (UCBR_EIGHTHS(clk, baud) / 8)
+#define UCBRS(clk, baud)            (UCBR_EIGHTHS(clk, baud) % 8)
+#define UCBR_OK(clk, baud)          (UCBR(clk, baud) >= 3 && UCBR(clk, baud) <= 0xFFFF)
+#if !UCBR_OK(DCO_SLOW_HZ, SLOW_BAUD) || !UCBR_OK(DCO_FAST_HZ, FAST_BAUD)
+#error "SLOW_BAUD or FAST_BAUD out of range for the DCO"
+#endif
+#if ACLK_XT1 && !UCBR_OK(XT1_HZ, SLOW_BAUD)
+#error "SLOW_BAUD too fast for the UART on the crystal"
+#endif
+
+#endif
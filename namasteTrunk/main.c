@@ -1,18 +1,71 @@
 /*
     main.c
-    Code for AMBER Board
+    Code for the Namaste boards, the pins and clocks of each are in boards.h
 */
 
 #include <msp430.h>
 #include <stdbool.h>
+#include "boards.h"
+#include "pins.h"
+#include "sched.h"
 
-/* pin definitions */
-#define DBG0    BIT0    /* P1.0 - debug pin 0 */
-#define SENVCC  BIT0    /* P2.0 - switch circuit power */
-#define SENSEIN BIT1    /* P2.1 - sensor input voltage signal */
-#define PCCOMM  BIT2    /* P2.2 - high indicates that the serial communications cable is plugged in */
-#define UARTRX  BIT4    /* P3.4 - UART RX Pin */
-#define UARTTX  BIT5    /* P3.5 - UART TX Pin */
+/* sensor channels: one mat per pin, all powered through SENVCC. Channels are numbered
+ * in the order P1.0 .. P1.7, P2.0 .. P2.7, P4.0 .. P4.7 over the pins the board profile
+ * sets in SENSE_P1_PINS, SENSE_P2_PINS and SENSE_P4_PINS, and each port is read once
+ * per sample */
+#define PIN_COUNT(m)    (((m) & 1) + (((m) >> 1) & 1) + (((m) >> 2) & 1) + (((m) >> 3) & 1) + \
+                         (((m) >> 4) & 1) + (((m) >> 5) & 1) + (((m) >> 6) & 1) + (((m) >> 7) & 1))
+#define SENSE_CHANNELS  (PIN_COUNT(SENSE_P1_PINS) + PIN_COUNT(SENSE_P2_PINS) + PIN_COUNT(SENSE_P4_PINS))
+#define MAX_CHANNELS    8       /* channel numbers have 3 bits in a record */
+#if SENSE_CHANNELS < 1 || SENSE_CHANNELS > MAX_CHANNELS
+#error "SENSE_P1_PINS, SENSE_P2_PINS and SENSE_P4_PINS must select 1 to 8 pins"
+#endif
+
+/* pin map (pins.h), pins without a role are inputs with the pull-down on. COUNTIN, on
+ * boards that have it, is one of them until STORE_COUNTS hands it to timer B */
+#if ACLK_XT1
+#define XT1_PINS        (XIN | XOUT)
+#else
+#define XT1_PINS        0       /* XIN and XOUT are unused inputs while ACLK runs from the VLO */
+#endif
+/*                       out low                out high  in                      pull-up  peripheral       peripheral out */
+#define P1_MAP  PORT_MAP(DBG0 | P1_SPARE_OUTS,  0,        SENSE_P1_PINS,          0,       0,               0)
+#define P2_MAP  PORT_MAP(SENVCC,                0,        PCCOMM | SENSE_P2_PINS, 0,       XT1_PINS,        0)
+#define P3_MAP  PORT_MAP(P3_SPARE_OUTS,         0,        0,                      0,       UARTTX | UARTRX, 0)
+#if BOARD_HAS_PORT4
+#define P4_MAP  PORT_MAP(0,                     0,        SENSE_P4_PINS,          0,       0,               0)
+#endif
+#include "pins.h"        /* checks the maps, a conflict is most likely a sensor channel on a pin in use */
+#if defined(COUNTIN) && (SENSE_P4_PINS & COUNTIN)
+#error "a sensor channel is on COUNTIN"
+#endif
+
+/* second timer, for the settle waits and the crystal checks: timer B, or Timer1_A2 on
+ * chips without one. Only bits the two have in common are used, by their timer A names.
+ * STORE_COUNTS counts on TBCLK, so it needs timer B and COUNTIN */
+#if BOARD_HAS_TIMERB
+#define AUX_CTL         TBCTL
+#define AUX_R           TBR
+#define AUX_CCTL0       TBCCTL0
+#define AUX_CCR0        TBCCR0
+#define AUX_VECTOR      TIMERB0_VECTOR
+#else
+#define AUX_CTL         TA1CTL
+#define AUX_R           TA1R
+#define AUX_CCTL0       TA1CCTL0
+#define AUX_CCR0        TA1CCR0
+#define AUX_VECTOR      TIMER1_A0_VECTOR
+#endif
+#if defined(COUNTIN) && BOARD_HAS_TIMERB
+#define HAS_COUNTS      1
+#else
+#define HAS_COUNTS      0
+#endif
+
+/* settling values */
+#define SETTLE_NONE     0
+#define SETTLE_LPM0     1       /* second timer on SMCLK, the DCO has to keep running */
+#define SETTLE_LPM3     2       /* second timer on ACLK */
 
 /* mode values */
 #define IDLEMODE        0       /* wait for communication with PC to get timestamp */
@@ -20,82 +73,324 @@
 #define UARTMODE        2       /* communicating with PC */
 #define UARTDONEMODE    3       /* done communicating with PC, but cable is still plugged in */
 #define SENSEMODE       4       /* periodically sample sensor and record timestamps of events */
+#define STREAMMODE      5       /* cable plugged in, sample sensor and push events to PC as they happen */
 
 /* mat state values */
 #define MAT_OPEN        1
 #define MAT_CLOSED      0
 #define MAT_UNDEF       0xFF    /* undefined mat state */
 #define MAT_STATE_SHIFT 31      /* shift the mat state 31 bits to the left to get it to the high bit of 32-bit timestamp */
+#define CHANNEL_SHIFT   28      /* with several channels, the channel is in bits 30..28 of a record */
 
 /* communications constants */
 #define ACK_VALUE       '!'
+#define NAK_VALUE       '?'     /* reply to a rejected configuration */
+#define FRAME_SOF       0x7E    /* start of a framed message: SOF, type, length, payload, checksum */
+#define FRAME_EVENT     'E'     /* payload: 32-bit record, same format as timestampStorage */
+#define FRAME_HEARTBEAT 'H'     /* payload: 32-bit curTimestamp */
+#define FRAME_SUMMARY   'U'     /* payload: logSummary */
 
-/* timing constants */
-// freddyChange: These timing values correspond to the use of the VLO oscillator for prototyping
-#define SENSEMODE_TIMER_PERIOD      20480   /* 15 sec, assuming 1365 Hz clock (ACLK/8) */
-#define UARTWAITMODE_TIMER_PERIOD   273     /* 200 ms, assuming 1365 Hz clock (ACLK/8) */
-#define UARTMODE_TIMER_PERIOD       37      /* 1/300 sec, assuming 10922 Hz clk (ACLK) */
-#define UARTDONEMODE_TIMER_PERIOD   1366    /* 1 sec, assuming 1365 Hz clock (ACLK/8) */
+/* timing constants, in scheduler ticks of the oscillator in use (ticksPerSec) */
+#define VLO_TICKS_PER_SEC           VLO_ACLK_TICKS
+#define XT1_TICKS_PER_SEC           XT1_ACLK_TICKS
+#define UARTWAITMODE_TIMER_PERIOD   ((ticksPerSec + 4) / 5)    /* 200 ms, at least one tick */
+#define UARTDONEMODE_TIMER_PERIOD   ticksPerSec         /* 1 sec */
+#define SENSE_TIMER_PERIOD          ((unsigned long)params.senseSeconds * ticksPerSec)
+
+/* scheduler timers (sched.h), each on its own compare channel of timer A unless SCHED_WDT */
+#define TIMER_SENSE     0       /* sense tick in SENSE and STREAM mode */
+#define TIMER_CABLE     1       /* PCCOMM debounce in UARTWAIT and UARTDONE mode */
+
+/* crystal start-up (ACLK_XT1), checked on the second timer from SMCLK/8 */
+#define XT1_CHECKS_PER_SEC          20
+#define XT1_CHECK_PERIOD            (DCO_SLOW_HZ / 8 / XT1_CHECKS_PER_SEC)     /* 50 ms */
+#if XT1_CHECK_PERIOD > 0xFFFF
+#error "XT1_CHECK_PERIOD does not fit AUX_CCR0"
+#endif
+#define XT1_STABLE_CHECKS           4       /* checks in a row without an oscillator fault before the crystal is used */
+#define XT1_START_CHECKS            40      /* give up and stay on the VLO after 2 s */
+#define XT1_OFF         0       /* ACLK from the VLO */
+#define XT1_STARTING    1       /* crystal selected, ACLK not yet trusted */
+#define XT1_RUNNING     2       /* ACLK from the crystal */
+
+/* clock levels: the DCO runs at its lowest calibrated frequency, the PC raises it with 'b'
+ * for bulk transfers, and the UART baud rate and flash timing generator divider follow */
+#define CLOCK_SLOW      0       /* DCO_SLOW_HZ, SLOW_BAUD: sensing, idle and docking, UART from ACLK once the crystal runs */
+#define CLOCK_FAST      1       /* DCO_FAST_HZ, FAST_BAUD: downloads, until the time is set or the cable is pulled */
+#define FTG_DIV_1MHZ    3       /* flash timing generator 257 - 476 kHz */
+#define FTG_DIV_8MHZ    19
 
-#define UARTWAIT_PCCOMM_HIGH_CNT    2       /* transition from UARTWAIT to UART mode when PCCOMM is high for 2 cycles (400 ms) */
 #define UART_PCCOMM_LOW_CNT         30      /* transition from UART mode to UARTDONE mode when PCCOMM is low for 30 baud cycles (100 ms) */
+
+/* sensor settle time, measured in 1 us cycles of SMCLK (divided down at CLOCK_FAST) with the second timer */
+#define SETTLE_TRIALS               4       /* power-ups of the sensor per measurement, the slowest one counts */
+#define SETTLE_OFF_CYCLES           2000    /* SENVCC off before each trial so the inputs start from rest */
+#define SETTLE_WINDOW_CYCLES        1000    /* inputs still changing after this are taken as noise */
+#define SETTLE_MIN_CYCLES           10      /* margin on top of the measured time, and the shortest wait */
+#define SMCLK_PER_VLO               (DCO_SLOW_HZ / VLO_HZ)     /* 1 us cycles per ACLK period, rounded down so */
+#define SMCLK_PER_XT1               (DCO_SLOW_HZ / XT1_HZ)     /* the wait on ACLK never comes out short */
+#define SETTLE_ACLK_CYCLES          (4 * SMCLK_PER_VLO)   /* 4 VLO periods: longer waits sleep in LPM3 on ACLK instead of LPM0 */
+
+/* sensing parameters (defaults, changed at runtime with 'c' and kept in information memory,
+ * the default sense period SENSE_SECONDS is in the board profile) */
+#define SENSE_SECONDS_MAX           48      /* longest sense period the PC may set */
+#if SENSE_SECONDS < 1 || SENSE_SECONDS > SENSE_SECONDS_MAX
+#error "SENSE_SECONDS out of range"
+#endif
+#define UARTWAIT_PCCOMM_HIGH_CNT    2       /* transition from UARTWAIT to UART mode when PCCOMM is high for 2 cycles (400 ms) */
 #define UARTDONE_PCCOMM_LOW_CNT     2       /* transition from UARTDONE to SENSE mode when PCCOMM is low for 2 cycles (2 seconds) */
+#define CONFIRM_SAMPLES             1       /* consecutive samples a new mat state needs before it counts (1 = no hysteresis) */
+#define DWELL_SAMPLES               0       /* further samples a new mat state must last before it is recorded (0 = record at once) */
+#define STORAGE_MODE                STORE_EDGES
+#define BUCKET_HOURS                1       /* length of an occupancy bucket in STORE_OCCUPANCY mode */
+#define BUCKET_HOURS_MAX            24
+#define SENSE_MODE                  SENSE_DIGITAL
+#define CLOSED_THRESHOLD            341     /* analog sensing: readings at or below this are MAT_CLOSED */
+#define OPEN_THRESHOLD              682     /* analog sensing: readings at or above this are MAT_OPEN */
+#define PARAM_MAGIC                 0x4E50  /* marks a written parameter block */
+#define PARAM_VERSION               5       /* layout of sensingParams */
+#define PARAM_BYTES                 14      /* 'g' reply and 'c' payload: version through openThreshold */
+
+/* sense modes */
+#define SENSE_DIGITAL       0   /* SENSEIN read as a digital input */
+#define SENSE_ANALOG        1   /* SENSEIN converted with ADC10 and compared against the thresholds */
+#define ADC_MAX             1023
+
+/* storage modes */
+#define STORE_EDGES         0   /* one record per mat state change */
+#define STORE_OCCUPANCY     1   /* one record per bucket with the number of occupied (MAT_CLOSED) samples */
+#define STORE_COUNTS        2   /* one record per bucket with the number of presses, counted by timer B */
+
+/* occupancy records (STORE_OCCUPANCY, STORE_COUNTS): a base record holds the start
+ * of a bucket with the high bit set, each bucket record holds its offset in buckets
+ * from the last base record and its number of occupied samples or presses */
+#define BASE_RECORD_FLAG        0x80000000
+#define BUCKET_OFFSET_SHIFT     16
+#define BUCKET_OFFSET_MAX       0x7FFF
+#define BUCKET_COUNT_MAX        0xFFFF
 
 /* buffer and memory sizes */
 #define TIMESTAMP_BYTES         4           /* 31-bit UNIX timestamp (integer seconds from epoch) */
+#define PHASED_TIME_BYTES       6           /* 'Q' time: timestamp, then sub-second phase in timer ticks */
 #define TIMESTAMP_MASK          0x7FFFFFFF  /* 31-bit UNIX timestamp */
+#if SENSE_CHANNELS > 1
+#define RECORD_TIME_MASK        0x0FFFFFFF  /* low 28 bits of the UNIX timestamp, see recordTime() */
+#else
+#define RECORD_TIME_MASK        TIMESTAMP_MASK
+#endif
 #define TIMESTAMP_BUFF_SIZE     8
 #define TIMESTAMP_STOR_SIZE     128     /* must be 128 if using 4-byte timestamps (needs to use 1 segment = 512 bytes) */
 
+/* block encodings (STORE_EDGES): the RAM buffer goes to flash as one block of
+ * TIMESTAMP_BUFF_SIZE words, either edge records or a bitmap of the recorded mat
+ * state with one bit per sample, whichever covers more time. A bitmap block holds
+ * the time of its first sample, then sense seconds << 8 | number of samples, then
+ * the samples from bit 0 of word 2 on. Which flash blocks are bitmaps is kept in
+ * bitmapBlocks, and downloads decode them back into edge records */
+#define BLOCK_UNDECIDED         0       /* filling both encodings */
+#define BLOCK_EDGES             1
+#define BLOCK_BITMAP            2
+#define BITMAP_HEADER_WORDS     2
+#define BITMAP_SAMPLES          ((TIMESTAMP_BUFF_SIZE - BITMAP_HEADER_WORDS) * 32)
+#define BITMAP_SECONDS_SHIFT    8
+#define BITMAP_IDLE             0xFF    /* bitmapCount when no bitmap is being filled */
+
 /* macros */
 #define PCCOMMIntrOn()  do{P2IFG &= ~(PCCOMM); P2IE |= PCCOMM;}while(0)     /* turn on PC comm. interrupt */
 #define PCCOMMIntrOff() do{P2IE &= ~(PCCOMM); P2IFG &= ~(PCCOMM);}while(0)  /* turn off PC comm. interrupt */
-#define getNumTimestamps()  (((unsigned short)timeStorIndex) + ((unsigned short)timeBufferIndex))   /* returns the total number of stored timestamps */
+#define storageHasRoom()    ((timeStorIndex + TIMESTAMP_BUFF_SIZE) <= TIMESTAMP_STOR_SIZE)   /* another block fits in flash */
 
 /* debugging */
 #define ONE_DELAY 5000
 
+/* sensing parameters, in the byte order they are sent over the UART after the magic */
+typedef struct {
+  unsigned short magic;             /* PARAM_MAGIC */
+  unsigned char version;            /* PARAM_VERSION */
+  unsigned char senseSeconds;       /* 1 .. SENSE_SECONDS_MAX */
+  unsigned char uartWaitHighCnt;    /* 200 ms cycles PCCOMM must be high before UART mode, 1 .. 255 */
+  unsigned char uartDoneLowCnt;     /* 1 sec cycles PCCOMM must be low before SENSE mode, 1 .. 255 */
+  unsigned char confirmSamples;     /* event filter hysteresis, 1 .. 255 */
+  unsigned char dwellSamples;       /* event filter minimum dwell, 0 .. 255 */
+  unsigned char storageMode;        /* STORE_EDGES, STORE_OCCUPANCY or STORE_COUNTS */
+  unsigned char bucketHours;        /* 1 .. BUCKET_HOURS_MAX, at most BUCKET_COUNT_MAX samples per bucket */
+  unsigned char channels;           /* SENSE_CHANNELS, read only: the PC learns the record format from it */
+  unsigned char senseMode;          /* SENSE_DIGITAL or SENSE_ANALOG (single channel builds only) */
+  unsigned short closedThreshold;   /* analog sensing hysteresis, calibrated per device, */
+  unsigned short openThreshold;     /* closedThreshold < openThreshold <= ADC_MAX */
+  unsigned short checksum;          /* complement of the sum of the words above */
+} sensingParams;
+
+/* position of a walk over the stored records */
+typedef struct {
+  unsigned short index;             /* index of the next record */
+  unsigned char block;              /* flash block, the RAM buffer after the last one */
+  unsigned char pos;                /* word or sample within the block */
+  unsigned char matState;           /* state of the last record, a bitmap only yields changes from it */
+} logCursor;
+
+/* event filter and occupied time of one channel */
+typedef struct {
+  unsigned char prevMatState;       /* last recorded mat state */
+  unsigned char runState;           /* mat state of the current run of samples */
+  unsigned char runLength;          /* number of samples in the current run */
+  unsigned long runStart;           /* timestamp of the first sample of the run */
+  unsigned char confirmedState;     /* mat state after hysteresis */
+  unsigned char pendingState;       /* confirmed change waiting out the dwell time, MAT_UNDEF if none */
+  unsigned long pendingTime;        /* timestamp of the pending change */
+  unsigned char pendingAge;         /* samples since the pending change was confirmed */
+  unsigned long closedSince;        /* start of the MAT_CLOSED time being counted, 0 if none */
+} channelState;
+
+/* log summary since the last 'r', kept up to date as events are recorded */
+typedef struct {
+  unsigned short events;            /* mat state changes recorded, stored or not */
+  unsigned long firstTime;          /* timestamp of the first of them, 0 if none */
+  unsigned long lastTime;           /* timestamp of the last of them */
+  unsigned long occupiedSeconds;    /* time between a MAT_CLOSED change and the next change or docking, all channels */
+  unsigned short droppedRecords;    /* records that found the storage full */
+  unsigned short filteredEvents;    /* changes dropped by the event filter */
+} logSummary;
+
 /* function prototypes */
 /* interrupts */
 __interrupt void P2_ISR(void);
-__interrupt void TA_ISR(void);
+__interrupt void AUX_ISR(void);
+__interrupt void NMI_ISR(void);
 __interrupt void USCI0RX_ISR(void);
 
 /* timer setups */
-void timerASetup(unsigned char op_mode);
+void startTimers(void);
+bool senseTick(void);
+bool cableTick(void);
+void updateClock(void);
+unsigned short readClock(unsigned long * seconds);
+void measureSettle(void);
+void startSettle(void);
+void stopSettle(void);
+void waitSettle(void);
+void startCrystal(void);
+void checkCrystal(void);
+void endCrystalStart(void);
+void useVlo(void);
+void clockSetup(unsigned char level);
 
 /* UART functions */
 void uartWaitModeStart(void);
 void uartModeStart(void);
 void uartModeStop(void);
 void startIdleSenseMode(void);
+void startSensing(void);
+void stopSensing(void);
 void send16bit(unsigned short val);
 void send32bit(unsigned long val);
+void sendFrame(unsigned char type, const unsigned char * payload, unsigned char len);
+void streamModeStart(void);
+void streamModeStop(void);
 void transmitChar(char charToTransmit);
 void UARTSetup(void);
 void UARTSleep(void);
 
+/* sensing parameters */
+void loadParams(void);
+bool paramsValid(const sensingParams * p);
+unsigned short paramsChecksum(const sensingParams * p);
+void saveParams(void);
+
+/* sensor channels and event filter */
+unsigned char readChannels(void);
+unsigned char readAnalog(void);
+unsigned short convertSensor(void);
+unsigned char collectPins(unsigned char in, unsigned char mask, unsigned char * channel);
+void resetEventFilter(void);
+void filterSample(unsigned char channel, unsigned char matState);
+
+/* occupancy histogram */
+void countOccupancy(void);
+void commitBucket(void);
+void startCounting(void);
+void stopCounting(void);
+unsigned short readPresses(void);
+
 /* Flash memory / data storage functions */
-void recordEvent(unsigned char matState);
+void recordEvent(unsigned char channel, unsigned char matState, unsigned long timestamp);
+void storeRecord(unsigned long record);
+void writeBlock(const unsigned long * block);
 void clearTimestamps(void);
+void endClosedRun(channelState * ch, unsigned long timestamp);
+unsigned long recordTime(unsigned long record);
+unsigned short getNumTimestamps(void);
 unsigned long getTimestamp(unsigned short timestampIndex);
+unsigned short findRange(unsigned long first, unsigned long last);
+
+/* adaptive block encoding */
+void storeEdge(unsigned long record);
+void startBitmap(unsigned long timestamp);
+void setBitmapState(unsigned long timestamp, unsigned char matState);
+void sampleBitmap(void);
+void writeBitmap(void);
+void closeBlock(void);
+void resetCursor(logCursor * c);
+void seekBlock(logCursor * c, unsigned char block);
+bool nextRecord(logCursor * c, unsigned long * record);
  
 /* shared variables */
 /* time variables */
 static unsigned long curTimestamp;      /* current system timestamp in seconds from epoch (UNIX timestamp) */
+static unsigned short subSecTicks;      /* timer ticks past curTimestamp at clockTicks */
+static unsigned long clockTicks;        /* schedNow() when curTimestamp and subSecTicks were brought up to date */
+static unsigned short ticksPerSec = VLO_TICKS_PER_SEC;  /* scheduler ticks in one second, unit of the sub-second phase */
+static unsigned long setTimestamp;      /* time last received with 'q', 'Q' or 'l', 0 if never, sent back with 't' */
+static unsigned short setPhase;         /* sub-second phase received with it, 0 unless 'Q' */
+volatile static unsigned char xt1State; /* XT1_OFF, XT1_STARTING or XT1_RUNNING */
+static unsigned char xt1Checks;         /* crystal checks in a row without a fault */
+static unsigned char xt1Starts;         /* crystal checks since it was selected */
+volatile static bool xt1Fault;          /* the running crystal failed, main goes back to the VLO */
+static unsigned char clockLevel;        /* CLOCK_SLOW or CLOCK_FAST */
+static unsigned short auxSmclk;         /* AUX_CTL source bits that count 1 us on SMCLK at that level */
 static unsigned char timeBufferIndex;   /* current index into timestampBuffer */
 static unsigned long timestampBuffer[TIMESTAMP_BUFF_SIZE]; /* buffer holding timestamps of all events */
 static unsigned char timeStorIndex;     /* current index into timestampStorage */
 #pragma location="FLASH_TIMESTAMP_STORAGE"
 const unsigned long timestampStorage[TIMESTAMP_STOR_SIZE]; /* segment of flash to hold saved timestamps */
+
+/* sensing parameters */
+static sensingParams params;            /* parameters in use */
+#pragma location="INFOD"
+const sensingParams storedParams;       /* information memory segment D, survives firmware updates */
  
 /* mode and state */
 volatile static unsigned char mode;     /* system mode */
 static unsigned char pcCommStableCnt;   /* number of seconds that PCCOMM is stable */
-static unsigned char prevMatState;      /* Previous state of mat */
+volatile static unsigned char settling; /* SENVCC is on and the second timer runs to the sample, SETTLE_LPM0 or SETTLE_LPM3 */
+static unsigned short settleCycles;     /* 1 us cycles the sensor inputs need after SENVCC goes on */
+
+/* sensor channels */
+static channelState channels[SENSE_CHANNELS];
+static unsigned char analogState = MAT_UNDEF;   /* last thresholded state, kept between the thresholds */
+
+/* log summary */
+static logSummary summary;
+
+/* occupancy histogram */
+static unsigned long bucketStart;       /* start of the bucket being counted, 0 if none */
+static unsigned short bucketOccupied;   /* occupied samples or presses in that bucket */
+static unsigned long baseBucket;        /* bucket start in the last base record, 0 if none since the last 'r' */
+
+/* adaptive block encoding (STORE_EDGES) */
+static unsigned char blockMode;         /* encoding of the block being filled */
+static unsigned long bitmapBuffer[TIMESTAMP_BUFF_SIZE]; /* the same block as a bitmap */
+static unsigned char bitmapCount;       /* samples in bitmapBuffer, BITMAP_IDLE if not started */
+static unsigned short bitmapBlocks;     /* bit n set: block n of timestampStorage is a bitmap */
+static logCursor readStart;             /* record 0 of the walk with 'e', set by 'd' or 'f' */
+static logCursor readCursor;            /* where getTimestamp() left off */
+static unsigned short downloadCount;    /* number of records announced by the last 'd' or 'f' */
 
 /* UART communications */
 static bool recvingTimestamp;           /* true when we are receiving the timestamp (after quit) */
+static bool recvingParams;              /* true when we are receiving a configuration (after 'c') */
+static bool recvingRange;               /* true when we are receiving a time range (after 'f') */
+static bool recvingBaud;                /* true when we are receiving a clock level (after 'b') */
 
 /* mainloop */
 void main(void) {
@@ -104,47 +399,15 @@ void main(void) {
   __disable_interrupt();      // disable global interrupts during initialization
 
   /* *** initialize all pins ***
-   * 
-   * This is done in one step to optimize code space. The following settings are used:
    *
-   * Defaults:
-   *  - digital I/O
-   *  - input
-   *  - pull-down resistor enabled
-   *
-   * Non-digital I/Os: 
-   *  P1: ()
-   *  P2: ()
-   *  P3: (UARTTX | UARTRX)
-   * Outputs: 
-   *  P1: (DBG0)
-   *  P2: (SENVCC)
-   *  P3: ()
-   * Pull-ups:
-   *  P1: ()
-   *  P2: ()
-   *  P3: ()
-   * Disabled pull-up/downs: 
-   *  P1: (DBG0)
-   *  P2: (PCCOM | SENSEIN | SENVCC)
-   *  P3: (UARTTX | UARTRX)
+   * One write per register from the pin map (P1_MAP .. P4_MAP above)
    */
-  /* set inputs and outputs */
-  P1DIR = DBG0; /* debugging leds are outputs. all others are inputs / don't cares */
-  P2DIR = SENVCC;
-  
-  /* use pulldowns */
-  P1OUT = 0;
-  P2OUT = 0;
-  P3OUT = 0;
-
-  /* enable/disable pull-downs */
-  P1REN = (unsigned char)(~DBG0);
-  P2REN = (unsigned char)(~(PCCOMM | SENSEIN | SENVCC));
-  P3REN = (unsigned char)(~(UARTTX | UARTRX));
-
-  /* set I/O type */
-  P3SEL = (UARTTX | UARTRX);
+  PORT_SETUP(1, P1_MAP);
+  PORT_SETUP(2, P2_MAP);
+  PORT_SETUP(3, P3_MAP);
+#if BOARD_HAS_PORT4
+  PORT_SETUP(4, P4_MAP);
+#endif
 
   /* initialize interrupt pins */
   P2IES &= ~(PCCOMM);                 /* respond to rising edge of PCCOMM */
@@ -152,17 +415,15 @@ void main(void) {
   // freddyChange: use this to run on AMBER Board independently
   /* *** setup clocks *** 
    * 
-   * XT1 = 10922 Hz (internal VLO)
-   * DCOCLK = 1 MHz, sourced from XT1
+   * XT1 = 10922 Hz (internal VLO), the crystal in ACLK_XT1 builds once it runs
+   * DCOCLK = DCO_SLOW_HZ, DCO_FAST_HZ at CLOCK_FAST (see clockSetup())
    * 
    * MCLK = DCOCLK
    * SMCLK = DCOCLK
    * ACLK = XT1
    */
-  DCOCTL = CALDCO_1MHZ;
-  BCSCTL1 = XT2OFF | CALBC1_1MHZ;
-  BCSCTL2 = 0;        /* SMCLK = DCOCLK */
-  BCSCTL3 = LFXT1S_2; /* use 10922 Hz VLO with 1pF effective load cap */
+  clockSetup(CLOCK_SLOW);   /* also sets up the flash timing generator */
+  BCSCTL3 = LFXT1S_2; /* use 10922 Hz VLO with 1pF effective load cap, ACLK_XT1 builds start the crystal in IDLE mode */
 
   /* wait until there are no osc. faults */
   do {
@@ -172,10 +433,9 @@ void main(void) {
     __delay_cycles(50);             /* wait 50 us */
   } while (IFG1 & OFIFG);             /* test oscillator fault flag */
 
-  /* *** setup FLASH controller *** */
-  FCTL2 = FWKEY + FSSEL0 + FN1;       /* MCLK/3 for Flash Timing Generator */
-
   /* *** initialize shared variables and mode *** */
+  measureSettle();
+  loadParams();
   curTimestamp = 0;
   clearTimestamps();
   startIdleSenseMode();   /* initially enter IDLE mode */
@@ -183,8 +443,14 @@ void main(void) {
   __enable_interrupt();   /* enable global interrupts */
 
   while (true) {                  /* mainloop */
-      if (mode == IDLEMODE) {
+      __disable_interrupt();      /* the low power modes enable them again, so a wakeup can't slip in between */
+      if (xt1Fault) {
+          useVlo();
+      }
+      if (mode == IDLEMODE && xt1State == XT1_OFF) {
           __low_power_mode_4();   /* turn off all clocks - just wait for cable to be plugged in*/
+      } else if (settling == SETTLE_LPM0 || xt1State == XT1_STARTING) {
+          __low_power_mode_0();   /* sensor settling or crystal checks on the SMCLK timer - CPU off */
       } else {
           __low_power_mode_3();   /* enter low power mode - only ACLK is on */
       }
@@ -196,52 +462,51 @@ __interrupt void P2_ISR(void)
 {
   if (P2IFG & PCCOMM) {       /* serial cable state changed */
     PCCOMMIntrOff();
-    uartWaitModeStart();    /* wait until cable is stable before starting UART mode */
-    __low_power_mode_off_on_exit(); /* change power modes if transitioning out of IDLEMODE */
+    if (mode == STREAMMODE) {   /* cable pulled while streaming, keep sensing */
+      streamModeStop();
+    } else {
+      uartWaitModeStart();    /* wait until cable is stable before starting UART mode */
+      __low_power_mode_off_on_exit(); /* change power modes if transitioning out of IDLEMODE */
+    }
   }
 }
 
-#pragma vector=TIMERA0_VECTOR
-__interrupt void TA_ISR(void) {
-
-  switch(mode)
-  {
-  case UARTWAITMODE:
-    if (P2IN & PCCOMM) {            /* PC comm pin is high (cable is still connected) */
-      if (++pcCommStableCnt == UARTWAIT_PCCOMM_HIGH_CNT) {
-                                /* cable is stable and connected, switch to UART mode */
-        uartModeStart();        /* switch to UART mode */
-      }
-    } else {                        /* cable is disconnected */
-      pcCommStableCnt = 0;        /* reset counter */
-    }
-    break;
-  case UARTDONEMODE:
-    if (curTimestamp != 0) {    // update time
-      curTimestamp += 1;        // increment by 1 second
-    }
-    if (!(P2IN & PCCOMM)) {         /* PC comm pin is low (cable is disconnected) */
-      if (++pcCommStableCnt == UARTDONE_PCCOMM_LOW_CNT) {
-                                        /* cable has been disconnected, switch to SENSE mode */
-        startIdleSenseMode();   /* switch to IDLE or SENSE mode */
-        __low_power_mode_off_on_exit(); /* change power modes if transitioning to IDLEMODE */
-      }
-    } else {                        /* cable is still connected */
-      pcCommStableCnt = 0;          /* reset counter */
+#pragma vector=AUX_VECTOR
+__interrupt void AUX_ISR(void) {
+  if (xt1State == XT1_STARTING) {
+    checkCrystal();
+    return;
+  }
+  stopSettle();
+  if (mode == SENSEMODE || mode == STREAMMODE) {
+    unsigned char states;
+    unsigned char channel;
+    if (params.senseMode == SENSE_ANALOG) {
+      states = readAnalog();
+    } else {
+      states = readChannels();          /* every mat in one wake */
     }
-    break;
-  case SENSEMODE:
-    if (curTimestamp != 0) {    // update time
-      curTimestamp += 15;       // increment by 15 seconds
+    P2OUT &= ~SENVCC;
+    for (channel = 0; channel < SENSE_CHANNELS; channel++) {
+      filterSample(channel, ((states >> channel) & 1) ? MAT_OPEN : MAT_CLOSED);
     }
-    P2OUT |= SENVCC;
-    if (prevMatState != MAT_OPEN && (P2IN & SENSEIN)) {
-      recordEvent(MAT_OPEN);
-    } else if(prevMatState != MAT_CLOSED && !(P2IN & SENSEIN)) {
-      recordEvent(MAT_CLOSED);
+    countOccupancy();
+    sampleBitmap();
+    if (mode == STREAMMODE) {   /* let the PC know we are alive and what time we think it is */
+      sendFrame(FRAME_HEARTBEAT, (const unsigned char *)&curTimestamp, TIMESTAMP_BYTES);
     }
-    P2OUT &= ~SENVCC;
-    break;
+  }
+  __low_power_mode_off_on_exit(); /* back to LPM3 */
+}
+
+// oscillator fault of the running crystal: OFIE is cleared by the NMI itself, and the
+// switch to the VLO is left to main so the timer is not reprogrammed inside another ISR
+#pragma vector=NMI_VECTOR
+__interrupt void NMI_ISR(void)
+{
+  if (xt1State == XT1_RUNNING) {
+    xt1Fault = true;
+    __low_power_mode_off_on_exit();
   }
 }
 
@@ -253,55 +518,220 @@ __interrupt void USCI0RX_ISR(void)
 {
   static unsigned short sendingIndex = 0;
   static unsigned long rcvTimestamp = 0;
+  static unsigned short rcvPhase;         /* sub-second part of a 'Q' time */
+  static unsigned long rcvStartTicks;     /* schedNow() when 'Q' arrived, the instant the 'Q' time refers to */
+  static unsigned char rcvCommand;        /* command the timestamp being received belongs to */
+  static unsigned char rcvLength;         /* number of time bytes expected after the command */
+  static sensingParams rcvParams;         /* configuration being received after 'c' */
+  static unsigned long rcvRange[2];       /* first and last timestamp being received after 'f' */
   
-  if(recvingTimestamp) {
-    rcvTimestamp |= ((unsigned long)UCA0RXBUF) << (8 * sendingIndex);
+  if (mode == STREAMMODE) {
+    // Stop streaming, send 1 byte ACK and wait for more commands
+    if (UCA0RXBUF == 'x') {
+      PCCOMMIntrOff();
+      P2IES &= ~(PCCOMM);         /* back to rising edge for the next docking */
+      updateClock();
+      stopSensing();              /* no samples in UART mode */
+      uartModeStart();            /* wait for more commands */
+      transmitChar(ACK_VALUE);
+    }
+  } else if(recvingTimestamp) {
+    if (sendingIndex < TIMESTAMP_BYTES) {
+      rcvTimestamp |= ((unsigned long)UCA0RXBUF) << (8 * sendingIndex);
+    } else {
+      rcvPhase |= ((unsigned short)UCA0RXBUF) << (8 * (sendingIndex - TIMESTAMP_BYTES));
+    }
     
-    if(++sendingIndex == TIMESTAMP_BYTES)
+    if(++sendingIndex == rcvLength)
     {
       curTimestamp = rcvTimestamp;    /* save timestamp */
+      setTimestamp = rcvTimestamp;    /* so the PC can tell which time set its next 't' follows */
+      setPhase = rcvPhase;
       recvingTimestamp = false;
-      uartModeStop();                 /* UART mode completed */
+      subSecTicks = 0;                /* new time starts on a whole second */
+      clockTicks = schedNow();
+      if (rcvCommand == 'Q') {        /* time was for the 'Q' byte, add the ticks since then */
+        subSecTicks = rcvPhase;
+        clockTicks = rcvStartTicks;
+        updateClock();
+      }
+      if (rcvCommand == 'l') {
+        streamModeStart();            /* stay connected and push events */
+      } else {
+        uartModeStop();               /* UART mode completed */
+      }
+    }
+  } else if (recvingParams) {
+    (&rcvParams.version)[sendingIndex] = UCA0RXBUF;
+    if (++sendingIndex == PARAM_BYTES) {
+      recvingParams = false;
+      if (rcvParams.version == PARAM_VERSION && paramsValid(&rcvParams) &&
+          (rcvParams.storageMode == params.storageMode ||
+           (timeStorIndex == 0 && timeBufferIndex == 0))) {   /* the log is decoded with the mode it was written in */
+        params = rcvParams;           /* counts apply now, the sense period with the next startTimers() */
+        baseBucket = 0;               /* bucket length may have changed, start with a new base record */
+        saveParams();
+        transmitChar(ACK_VALUE);
+      } else {
+        transmitChar(NAK_VALUE);
+      }
+    }
+  } else if (recvingBaud) {
+    recvingBaud = false;
+    if (UCA0RXBUF <= CLOCK_FAST) {
+      transmitChar(ACK_VALUE);
+      while (UCA0STAT & UCBUSY);      /* let the ACK go out at the old rate */
+      clockSetup(UCA0RXBUF);
+      UARTSetup();
+    } else {
+      transmitChar(NAK_VALUE);
+    }
+  } else if (recvingRange) {
+    rcvRange[sendingIndex / TIMESTAMP_BYTES] |= ((unsigned long)UCA0RXBUF) << (8 * (sendingIndex % TIMESTAMP_BYTES));
+    if (++sendingIndex == 2 * TIMESTAMP_BYTES) {
+      recvingRange = false;
+      downloadCount = findRange(rcvRange[0] & TIMESTAMP_MASK, rcvRange[1] & TIMESTAMP_MASK);
+      send16bit(downloadCount);
+      sendingIndex = 0;
     }
   } else {
     switch(UCA0RXBUF) {
 
     // Quitting, send 1 byte ack after receiving new timestamp
+    // Live streaming, send 1 byte ack, then start streaming after receiving new timestamp
+    // Phased quitting, send 1 byte ack after receiving new timestamp (4 bytes) and the
+    // sub-second phase (2 bytes) the PC computed for the moment this byte arrived
     case 'q':
+    case 'l':
+    case 'Q':
+      rcvStartTicks = schedNow();
+      rcvCommand = UCA0RXBUF;
+      rcvLength = (rcvCommand == 'Q') ? PHASED_TIME_BYTES : TIMESTAMP_BYTES;
       sendingIndex = 0;
+      rcvTimestamp = 0;
+      rcvPhase = 0;
       recvingTimestamp = true;
       transmitChar(ACK_VALUE);
       break;
 
+    // Reading the clock, send curTimestamp (4 bytes), sub-second phase (2 bytes)
+    // and timer ticks per second (2 bytes) so the PC can measure drift before 'q',
+    // then the time last set (4 + 2 bytes) so it knows which time set to measure from
+    case 't':
+      {
+        unsigned long seconds;
+        unsigned short phase = readClock(&seconds);
+        send32bit(seconds);
+        send16bit(phase);
+        send16bit(ticksPerSec);
+        send32bit(setTimestamp);
+        send16bit(setPhase);
+      }
+      break;
+
+    // Pinging, send the clock when the ping arrived (4 + 2 bytes) and the phase just
+    // before replying (2 bytes) so the PC can measure the round trip
+    case 'p':
+      {
+        unsigned long seconds;
+        unsigned short rxPhase = readClock(&seconds);
+        unsigned short txPhase = readClock(0);
+        send32bit(seconds);
+        send16bit(rxPhase);
+        send16bit(txPhase);
+      }
+      break;
+
     // Resetting, send 1 byte ACK
     case 'r':
-    /* NOTE: because the FLASH erase operation in clearTimestamps() is so long,
-    * serial timer interrupts will be missed, and will then be handled
-    * as soon as the function returns, which will mess up the regular
-    * timing of the serial timer interrupts.
-    * Therefore, we must turn off the timer interrupt during the erase
-    * operation, yet keep the timer running to ensure that the
-    * timing is correct for the serial timer interrupts.
+    /* NOTE: a deadline that passes during the long FLASH erase in
+    * clearTimestamps() fires as soon as the function returns. Timer A
+    * keeps counting and periodic timers are set from their last deadline,
+    * so the timing of the following ticks is not affected.
     */
-      CCTL0 = 0;              /* disable serial timer interrupts */
       clearTimestamps();
-      CCTL0 = CCIE;           /* re-enable serial timer interrupts */
       transmitChar(ACK_VALUE);
       break;
 
     // Initializing sending, send number of timestamps (2 bytes)
     case 'd':
-      send16bit(getNumTimestamps());
+      downloadCount = getNumTimestamps();
+      send16bit(downloadCount);
+      resetCursor(&readStart);
+      readCursor = readStart;
       sendingIndex = 0;
       break;
 
+    // Querying a time range, receive the first and the last timestamp (4 bytes each),
+    // then send the number of records from first to last (2 bytes) as 'd' does for
+    // the whole log, 'e' then walks just those
+    case 'f':
+      sendingIndex = 0;
+      rcvRange[0] = 0;
+      rcvRange[1] = 0;
+      recvingRange = true;
+      break;
+
     // Asks for next timestamp (4 bytes)
     case 'e':
-      if (sendingIndex < getNumTimestamps()) {
+      if (sendingIndex < downloadCount) {
         send32bit(getTimestamp(sendingIndex++));
       }
       break;
 
+    // Getting the configuration, send the sensing parameters (PARAM_BYTES bytes)
+    case 'g':
+      {
+        unsigned char i;
+        for (i = 0; i < PARAM_BYTES; i++) {
+          transmitChar((&params.version)[i]);
+        }
+      }
+      break;
+
+    // Setting the configuration, receive PARAM_BYTES bytes in the 'g' layout, then
+    // send 1 byte ACK if they were valid and saved, NAK otherwise, also for a new
+    // storage mode while the log holds records
+    case 'c':
+      sendingIndex = 0;
+      recvingParams = true;
+      break;
+
+    // Reading the sensor, send one ADC10 conversion of SENSEIN (2 bytes) taken with
+    // SENVCC on, so the PC can calibrate the analog thresholds
+    case 'a':
+      P2OUT |= SENVCC;
+      waitSettle();
+      send16bit(convertSensor());
+      P2OUT &= ~SENVCC;
+      break;
+
+    // Changing the baud rate, receive a clock level (1 byte), then send 1 byte ACK at
+    // the old rate and switch, or NAK if there is no such level. CLOCK_FAST runs the
+    // DCO at 8 MHz and the UART at 115200 baud for downloads. UART mode only ends when
+    // the time is set, which goes back to CLOCK_SLOW, after 'l' when the cable is pulled
+    case 'b':
+      recvingBaud = true;
+      break;
+
+    // Asking for the number of mat state changes the event filter dropped (2 bytes)
+    case 'n':
+      send16bit(summary.filteredEvents);
+      break;
+
+    // Asking for the log summary, send it as one FRAME_SUMMARY frame
+    case 'u':
+      sendFrame(FRAME_SUMMARY, (const unsigned char *)&summary, sizeof(summary));
+      break;
+
+    // Updating firmware, send 1 byte ACK, then reset into the UART bootloader
+    // (BOOT/uartBoot), which stays put for the PC because the cable is plugged in
+    case 'B':
+      transmitChar(ACK_VALUE);
+      while (UCA0STAT & UCBUSY);      /* let the ACK go out */
+      WDTCTL = 0;                     /* wrong watchdog password resets the device */
+      break;
+
     // Ignore all other inputs
     default:
       break;
@@ -311,74 +741,364 @@ __interrupt void USCI0RX_ISR(void)
 
 /* *** Helper functions *** */
 
-// Sets up timer A with different settings depending on the mode
-void timerASetup(unsigned char op_mode) {
-  CCTL0 = 0;                              /* disable interrupt */
-  TACTL = 0;                              /* disable timer */
-
-  if (op_mode == UARTWAITMODE) {
-      CCR0 = UARTWAITMODE_TIMER_PERIOD - 1;
-      CCTL0 = CCIE;                       /* enable interrupt */
-      TACTL = TASSEL_1 | ID_3 | TACLR;    /* use ACLK/8 */
-  } else if (op_mode == UARTMODE) {
-      CCR0 = UARTMODE_TIMER_PERIOD - 1;
-      CCTL0 = CCIE;                       /* enable interrupt */
-      TACTL = TASSEL_1 | ID_0 | TACLR;    /* use ACLK/1 */
-  } else if (op_mode == UARTDONEMODE) {
-      CCR0 = UARTDONEMODE_TIMER_PERIOD - 1;
-      CCTL0 = CCIE;                       /* enable interrupt */
-      TACTL = TASSEL_1 | ID_3 | TACLR;    /* use ACLK/8 */
-  } else { /* SENSEMODE */
-      CCR0 = SENSEMODE_TIMER_PERIOD - 1;
-      CCTL0 = CCIE;                       /* enable interrupt */
-      TACTL = TASSEL_1 | ID_3 | TACLR;    /* use ACLK/8 */
-  }
-  TACTL |= MC_1;                          /* start time in up mode */
+// arm the scheduler timers of the current mode, the first deadlines one period from now.
+// Timer A keeps running, so no time is lost at the mode change
+void startTimers(void) {
+  unsigned long now = schedNow();
+  schedCancel(TIMER_SENSE);
+  schedCancel(TIMER_CABLE);
+  if (mode == UARTWAITMODE) {
+    schedAt(TIMER_CABLE, now + UARTWAITMODE_TIMER_PERIOD, cableTick);
+  } else if (mode == UARTDONEMODE) {
+    schedAt(TIMER_CABLE, now + UARTDONEMODE_TIMER_PERIOD, cableTick);
+  } else if (mode == SENSEMODE || mode == STREAMMODE) {
+    schedAt(TIMER_SENSE, now + SENSE_TIMER_PERIOD, senseTick);
+  }
+}
+
+// sense tick: sample the mats once the sensor has settled, or in STORE_COUNTS mode,
+// where timer B counts the presses, only look for the end of a bucket
+bool senseTick(void) {
+  schedAt(TIMER_SENSE, schedDeadline(TIMER_SENSE) + SENSE_TIMER_PERIOD, senseTick);
+  updateClock();
+  if (params.storageMode == STORE_COUNTS) {
+    countOccupancy();
+    if (mode == STREAMMODE) {
+      sendFrame(FRAME_HEARTBEAT, (const unsigned char *)&curTimestamp, TIMESTAMP_BYTES);
+    }
+    return false;
+  }
+  P2OUT |= SENVCC;
+  startSettle();              /* the sample is taken in TB_ISR once the inputs have settled */
+  return true;                /* main picks the low power mode for the wait */
+}
+
+// PCCOMM debounce: UART mode once the cable has been in for uartWaitHighCnt checks,
+// IDLE or SENSE mode once it has been out for uartDoneLowCnt checks
+bool cableTick(void) {
+  if (mode == UARTWAITMODE) {
+    if (P2IN & PCCOMM) {            /* PC comm pin is high (cable is still connected) */
+      if (++pcCommStableCnt == params.uartWaitHighCnt) {
+        uartModeStart();            /* cable is stable and connected, switch to UART mode */
+        return false;
+      }
+    } else {                        /* cable is disconnected */
+      pcCommStableCnt = 0;
+    }
+    schedAt(TIMER_CABLE, schedDeadline(TIMER_CABLE) + UARTWAITMODE_TIMER_PERIOD, cableTick);
+    return false;
+  }
+  if (!(P2IN & PCCOMM)) {           /* PC comm pin is low (cable is disconnected) */
+    if (++pcCommStableCnt == params.uartDoneLowCnt) {
+      startIdleSenseMode();         /* cable has been disconnected, switch to IDLE or SENSE mode */
+      return true;                  /* change power modes if transitioning to IDLEMODE */
+    }
+  } else {                          /* cable is still connected */
+    pcCommStableCnt = 0;
+  }
+  schedAt(TIMER_CABLE, schedDeadline(TIMER_CABLE) + UARTDONEMODE_TIMER_PERIOD, cableTick);
+  return false;
+}
+
+// measure how long the sensor inputs take to settle after SENVCC goes on: the second timer
+// counts SMCLK cycles while the inputs are polled, and the last change seen in any
+// trial plus a margin is the settle time. A mat that reads the same from the start
+// (closed at boot) gives just the margin, so the time is measured again on every
+// undocking and only ever grows
+void measureSettle(void) {
+  unsigned short last = 0;
+  unsigned char trial;
+
+  for (trial = 0; trial < SETTLE_TRIALS; trial++) {
+    unsigned char prev;
+    unsigned short now;
+    P2OUT &= ~SENVCC;
+    __delay_cycles(SETTLE_OFF_CYCLES);
+    AUX_CTL = auxSmclk | MC_2 | TACLR;    /* 1 us, continuous */
+    P2OUT |= SENVCC;
+    prev = readChannels();
+    while ((now = AUX_R) < SETTLE_WINDOW_CYCLES) {
+      unsigned char states = readChannels();
+      if (states != prev) {
+        prev = states;
+        last = (now > last) ? now : last;
+      }
+    }
+    P2OUT &= ~SENVCC;
+  }
+  AUX_CTL = 0;
+  last += last / 2 + SETTLE_MIN_CYCLES;
+  if (last > settleCycles) {
+    settleCycles = last;
+  }
+}
+
+// arm the second timer to end the settle time, on ACLK if it is long enough for that
+void startSettle(void) {
+  AUX_CCTL0 = 0;
+  if (settleCycles >= SETTLE_ACLK_CYCLES) {
+    /* rounds up, up mode counts AUX_CCR0 + 1 periods of the oscillator ACLK runs from */
+    AUX_CCR0 = settleCycles / ((xt1State == XT1_RUNNING) ? SMCLK_PER_XT1 : SMCLK_PER_VLO);
+    AUX_CTL = TASSEL_1 | TACLR;
+    settling = SETTLE_LPM3;
+  } else {
+    AUX_CCR0 = settleCycles - 1;
+    AUX_CTL = auxSmclk | TACLR;
+    settling = SETTLE_LPM0;
+  }
+  AUX_CCTL0 = CCIE;
+  AUX_CTL |= MC_1;                          /* up mode */
+}
+
+void stopSettle(void) {
+  AUX_CTL = 0;
+  AUX_CCTL0 = 0;
+  settling = SETTLE_NONE;
+}
+
+// busy wait for the settle time, for samples outside of the sense tick
+void waitSettle(void) {
+  AUX_CTL = auxSmclk | MC_2 | TACLR;
+  while (AUX_R < settleCycles);
+  AUX_CTL = 0;
+}
+
+// select the crystal for ACLK and check it every XT1_CHECK_PERIOD on the second timer, from IDLE
+// mode or when SENSE mode starts, with the DCO at CLOCK_SLOW. ACLK is not trusted until the
+// crystal is up, so the scheduler is stopped and the checks keep the time (endCrystalStart)
+void startCrystal(void) {
+  if (!ACLK_XT1 || xt1State != XT1_OFF) {
+    return;
+  }
+  if (mode != IDLEMODE) {
+    updateClock();
+    schedStop();
+  }
+  BCSCTL3 = LFXT1S_0 | XT1_XCAP;          /* crystal with the board's load capacitance */
+  IFG1 &= ~OFIFG;
+  xt1State = XT1_STARTING;
+  xt1Checks = 0;
+  xt1Starts = 0;
+  AUX_CCR0 = XT1_CHECK_PERIOD - 1;
+  AUX_CCTL0 = CCIE;
+  AUX_CTL = TASSEL_2 | ID_3 | MC_1 | TACLR; /* SMCLK/8, up mode */
+}
+
+// a fault since the last check starts the count again, the crystal is used once it has
+// run XT1_STABLE_CHECKS checks in a row, and dropped for the VLO if that takes too long
+void checkCrystal(void) {
+  xt1Starts++;
+  if (IFG1 & OFIFG) {
+    xt1Checks = 0;
+    IFG1 &= ~OFIFG;
+  } else if (++xt1Checks == XT1_STABLE_CHECKS) {
+    ticksPerSec = XT1_TICKS_PER_SEC;
+    xt1State = XT1_RUNNING;
+    IE1 |= OFIE;                          /* from now on a fault falls back to the VLO */
+    endCrystalStart();
+    if (mode == SENSEMODE) {
+      startSensing();
+    }
+    __low_power_mode_off_on_exit();
+    return;
+  }
+  if (xt1Starts == XT1_START_CHECKS) {
+    useVlo();
+    __low_power_mode_off_on_exit();
+  }
+}
+
+// stop the crystal checks and restart the scheduler on the ACLK now in use, the time
+// spent checking is added to the clock in periods of XT1_CHECK_PERIOD
+void endCrystalStart(void) {
+  AUX_CTL = 0;
+  AUX_CCTL0 = 0;
+  if (mode != IDLEMODE) {
+    if (xt1State == XT1_RUNNING) {
+      subSecTicks = (unsigned long)subSecTicks * XT1_TICKS_PER_SEC / VLO_TICKS_PER_SEC;
+    }
+    subSecTicks += (unsigned long)xt1Starts * ticksPerSec / XT1_CHECKS_PER_SEC;  /* at most 2 s */
+    schedStart();
+    clockTicks = schedNow();
+    updateClock();
+  }
+}
+
+// run ACLK from the VLO again, the time counted so far is kept and the phase
+// converted to VLO ticks
+void useVlo(void) {
+  bool starting = (xt1State == XT1_STARTING);
+  IE1 &= ~OFIE;
+  xt1Fault = false;
+  if (xt1State == XT1_RUNNING && mode != IDLEMODE) {
+    updateClock();
+    subSecTicks = (unsigned long)subSecTicks * VLO_TICKS_PER_SEC / XT1_TICKS_PER_SEC;
+  }
+  BCSCTL3 = LFXT1S_2;
+  IFG1 &= ~OFIFG;
+  schedClockChanged();
+  ticksPerSec = VLO_TICKS_PER_SEC;
+  xt1State = XT1_OFF;
+  if (starting) {
+    endCrystalStart();    /* the second timer is left alone otherwise, it may be counting presses */
+  }
+  if (mode == UARTMODE || mode == STREAMMODE) {
+    UARTSetup();          /* the UART cannot run from the VLO, back to SMCLK */
+  }
+  if (starting && mode == SENSEMODE) {
+    startSensing();
+  } else if (mode != IDLEMODE) {
+    startTimers();        /* deadlines in VLO ticks from now on */
+  }
+}
+
+// DCO, flash timing generator and settle timer source of a clock level. The flash
+// timing generator has to stay within 257 - 476 kHz at every DCO frequency, and
+// nothing may be erased or written while it is changed, so this is only called
+// between commands
+void clockSetup(unsigned char level) {
+  DCOCTL = 0;                             /* lowest DCOx and MODx while switching ranges */
+  if (level == CLOCK_FAST) {
+    BCSCTL1 = XT2OFF | CALBC1_8MHZ;
+    DCOCTL = CALDCO_8MHZ;
+    FCTL2 = FWKEY + FSSEL0 + (FTG_DIV_8MHZ - 1);
+    auxSmclk = TASSEL_2 | ID_3;           /* SMCLK/8 */
+  } else {
+    BCSCTL1 = XT2OFF | CALBC1_1MHZ;
+    DCOCTL = CALDCO_1MHZ;
+    FCTL2 = FWKEY + FSSEL0 + (FTG_DIV_1MHZ - 1);
+    auxSmclk = TASSEL_2;
+  }
+  BCSCTL2 = 0;                            /* MCLK = SMCLK = DCOCLK */
+  clockLevel = level;
+}
+
+// carry the ticks since clockTicks into subSecTicks and whole seconds into
+// curTimestamp, once the time is set
+void updateClock(void) {
+  unsigned long now = schedNow();
+  unsigned long ticks = now - clockTicks + subSecTicks;
+  clockTicks = now;
+  subSecTicks = (unsigned short)(ticks % ticksPerSec);
+  if (curTimestamp != 0) {
+    curTimestamp += ticks / ticksPerSec;
+  }
+}
+
+// read the clock without changing it, returns the sub-second phase and stores the
+// whole seconds in *seconds if it is not null
+unsigned short readClock(unsigned long * seconds) {
+  unsigned long ticks = schedNow() - clockTicks + subSecTicks;
+  if (seconds) {
+    *seconds = (curTimestamp != 0) ? curTimestamp + ticks / ticksPerSec : 0;
+  }
+  return (unsigned short)(ticks % ticksPerSec);
 }
 
 // Start UART wait mode (wait until cable is stable and then start UART mode)
 void uartWaitModeStart(void) {
+   if (xt1State == XT1_STARTING) {
+     useVlo();             // the scheduler needs a working ACLK now, the crystal is tried again in IDLE or SENSE mode
+   }
+   if (!schedRunning()) {  // from IDLE mode, there is no time yet
+     schedStart();
+     clockTicks = 0;
+     subSecTicks = 0;
+   }
+   updateClock();          // keep time while docked so the PC can read the drift
+   stopSensing();
    mode = UARTWAITMODE;
-   curTimestamp = 0;       // will stop keeping time, so throw out the timestamp
    pcCommStableCnt = 0;
-   timerASetup(mode);      // will generate periodic interrupts
+   startTimers();          // cable checks every 200 ms
 }
 
 // Start UART mode
 void uartModeStart(void) {
    mode = UARTMODE;
    recvingTimestamp = false;
+   recvingParams = false;
+   recvingRange = false;
+   recvingBaud = false;
    pcCommStableCnt = 0;
    UARTSetup();
    P1OUT |= DBG0;
-   CCTL0 = 0;              /* disable timer interrupt */
-   TACTL = 0;              /* disable timer */
+   startTimers();          // none, the scheduler keeps the time without a deadline
 }
 
-// Wake up every 1 second to keep time
+// Check the cable every 1 second
 void uartModeStop(void) {
   mode = UARTDONEMODE;
   pcCommStableCnt = 0;
   UARTSleep();
+  clockSetup(CLOCK_SLOW);
   P1OUT &= ~DBG0;
-  timerASetup(mode);      // will generate periodic interrupts
+  startTimers();          // will generate periodic interrupts
+}
+
+// Start STREAM mode (keep UART running and sense as in SENSE mode)
+void streamModeStart(void) {
+  mode = STREAMMODE;
+  resetEventFilter();
+  P2IES |= PCCOMM;          /* respond to falling edge of PCCOMM (cable pulled) */
+  PCCOMMIntrOn();
+  startTimers();            // will generate periodic interrupts
+}
+
+// Cable was pulled while streaming, switch to SENSE mode without touching the running timer
+void streamModeStop(void) {
+  P2IES &= ~(PCCOMM);       /* back to waiting for the cable to be plugged in */
+  UARTSleep();
+  clockSetup(CLOCK_SLOW);   /* the PC may have raised it before 'l' */
+  P1OUT &= ~DBG0;
+  mode = SENSEMODE;
+  if (params.storageMode == STORE_COUNTS) {
+    startCounting();        /* stopped since the cable was plugged in */
+  }
+  PCCOMMIntrOn();
 }
 
 // Transition to either SENSEMODE or IDLEMODE
 void startIdleSenseMode(void) {
    if (curTimestamp == 0) {    /* don't go to SENSE mode, just go into IDLE */
      mode = IDLEMODE;
-     CCTL0 = 0;                /* disable timer interrupt */
-     TACTL = 0;                /* disable timer */
+     schedStop();              /* no time to keep */
+     startCrystal();           /* ACLK_XT1 builds, if it is not running yet */
      PCCOMMIntrOn();
    } else {                    /* go into SENSE mode */
+     measureSettle();          /* another chance to see an open mat power up */
      mode = SENSEMODE;
-     prevMatState = MAT_UNDEF;
+     resetEventFilter();
      PCCOMMIntrOn();
-     timerASetup(mode);      // will generate periodic interrupts
+     if (ACLK_XT1 && xt1State == XT1_OFF) {
+       startCrystal();         // sensing starts once the crystal is up or given up on
+     } else {
+       startSensing();
+     }
    }
 }
 
+// start the press counter and the sense tick of SENSE mode
+void startSensing(void) {
+  if (params.storageMode == STORE_COUNTS) {
+    startCounting();
+  }
+  startTimers();          // will generate periodic interrupts
+}
+
+// end sensing for docking or for UART mode after streaming, the log and the summary
+// cover the time up to now
+void stopSensing(void) {
+  unsigned char channel;
+  commitBucket();         // so the PC downloads the occupancy or presses up to now
+  stopCounting();
+  stopSettle();           // a sample in progress is dropped
+  P2OUT &= ~SENVCC;
+  closeBlock();           // a bitmap cannot span the time docked
+  for (channel = 0; channel < SENSE_CHANNELS; channel++) {
+    endClosedRun(&channels[channel], curTimestamp);   // the mat state is unknown while docked
+  }
+}
+
 // sends 16-bit value low-order byte first
 void send16bit(unsigned short val) {
     unsigned char i;
@@ -397,6 +1117,20 @@ void send32bit(unsigned long val) {
     }
 }
 
+// sends a framed message: SOF, type, length, payload, then a checksum that makes
+// the sum of type, length, payload and checksum zero
+void sendFrame(unsigned char type, const unsigned char * payload, unsigned char len) {
+    unsigned char sum = type + len;
+    transmitChar(FRAME_SOF);
+    transmitChar(type);
+    transmitChar(len);
+    while (len--) {
+        sum += *payload;
+        transmitChar(*payload++);       /* multi-byte values go out low-order byte first */
+    }
+    transmitChar((char)(-sum));
+}
+
 // transmit a single char with the USCI_A module
 void transmitChar(char charToTransmit)
 {
@@ -404,14 +1138,28 @@ void transmitChar(char charToTransmit)
   UCA0TXBUF = charToTransmit;
 }
 
-// configure USCI module for UART mode
+// configure USCI module for UART mode. At CLOCK_SLOW with the crystal running the
+// UART is clocked from ACLK, so waiting for the PC while docked does not need the
+// DCO, which then only runs for the RX interrupt
 void UARTSetup(void)
 {
-  UCA0CTL1 |= UCSWRST;
-  UCA0CTL1 |= UCSSEL_2;                     // BRCLK = SMCLK = MCLK = 1MHz
-  UCA0BR0 = 104;                            // 1MHz/9600 = 104.166
-  UCA0BR1 = 0x00;
-  UCA0MCTL = UCBRS0;                        // Modulation UCBRSx = 1
+  UCA0CTL1 = UCSWRST;
+  if (clockLevel == CLOCK_SLOW && xt1State == XT1_RUNNING) {
+    UCA0CTL1 |= UCSSEL_1;                   // BRCLK = ACLK = crystal
+    UCA0BR0 = UCBR(XT1_HZ, SLOW_BAUD) & 0xFF;
+    UCA0BR1 = UCBR(XT1_HZ, SLOW_BAUD) >> 8;
+    UCA0MCTL = UCBRS(XT1_HZ, SLOW_BAUD) << 1;
+  } else if (clockLevel == CLOCK_FAST) {
+    UCA0CTL1 |= UCSSEL_2;                   // BRCLK = SMCLK = MCLK = DCO_FAST_HZ
+    UCA0BR0 = UCBR(DCO_FAST_HZ, FAST_BAUD) & 0xFF;
+    UCA0BR1 = UCBR(DCO_FAST_HZ, FAST_BAUD) >> 8;
+    UCA0MCTL = UCBRS(DCO_FAST_HZ, FAST_BAUD) << 1;
+  } else {
+    UCA0CTL1 |= UCSSEL_2;                   // BRCLK = SMCLK = MCLK = DCO_SLOW_HZ
+    UCA0BR0 = UCBR(DCO_SLOW_HZ, SLOW_BAUD) & 0xFF;
+    UCA0BR1 = UCBR(DCO_SLOW_HZ, SLOW_BAUD) >> 8;
+    UCA0MCTL = UCBRS(DCO_SLOW_HZ, SLOW_BAUD) << 1;
+  }
   UCA0CTL1 &= ~UCSWRST;                     // **Initialize USCI state machine**
   IE2 |= UCA0RXIE;                          // Enable USCI_A0 RX interrupt
 }
@@ -422,38 +1170,385 @@ void UARTSleep(void)
   UCA0CTL1 = UCSWRST;
 }
 
-// record event and timestamp in flash memory
-void recordEvent(unsigned char matState) {
-  /* timestamp buffer in RAM is full and there is space in the timestamp storage in FLASH */
-  if ((timeBufferIndex == TIMESTAMP_BUFF_SIZE) && 
-    ((timeStorIndex + TIMESTAMP_BUFF_SIZE) <= TIMESTAMP_STOR_SIZE))
-  {
-    /* copy RAM buffer to FLASH storage */
-    unsigned long * timestampStoragePtr = (unsigned long *)timestampStorage;
-    FCTL1 = FWKEY | WRT;                      // Set WRT bit (for write operations)
-    FCTL3 = FWKEY | LOCKA;                    // Clear LOCK bit
-    unsigned char i;
-    for (i = 0; i < TIMESTAMP_BUFF_SIZE; i++) {
-      timestampStoragePtr[timeStorIndex++] = timestampBuffer[i];
+/* *** Sensing parameters *** */
+
+// use the stored parameters if they are intact, the defaults otherwise
+void loadParams(void) {
+  if (storedParams.magic == PARAM_MAGIC && storedParams.version == PARAM_VERSION &&
+      storedParams.checksum == paramsChecksum(&storedParams) && paramsValid(&storedParams)) {
+    params = storedParams;
+  } else {
+    params.magic = PARAM_MAGIC;
+    params.version = PARAM_VERSION;
+    params.senseSeconds = SENSE_SECONDS;
+    params.uartWaitHighCnt = UARTWAIT_PCCOMM_HIGH_CNT;
+    params.uartDoneLowCnt = UARTDONE_PCCOMM_LOW_CNT;
+    params.confirmSamples = CONFIRM_SAMPLES;
+    params.dwellSamples = DWELL_SAMPLES;
+    params.storageMode = STORAGE_MODE;
+    params.bucketHours = BUCKET_HOURS;
+    params.channels = SENSE_CHANNELS;
+    params.senseMode = SENSE_MODE;
+    params.closedThreshold = CLOSED_THRESHOLD;
+    params.openThreshold = OPEN_THRESHOLD;
+  }
+}
+
+// check the parameters against the longest sense period, the mode counters and the bucket count,
+// occupancy buckets and analog sensing are for a single channel only
+bool paramsValid(const sensingParams * p) {
+  return p->senseSeconds != 0 && p->senseSeconds <= SENSE_SECONDS_MAX &&
+         p->uartWaitHighCnt != 0 && p->uartDoneLowCnt != 0 && p->confirmSamples != 0 &&
+         p->storageMode <= (HAS_COUNTS ? STORE_COUNTS : STORE_OCCUPANCY) && p->bucketHours != 0 && p->bucketHours <= BUCKET_HOURS_MAX &&
+         p->bucketHours * 3600UL / p->senseSeconds <= BUCKET_COUNT_MAX &&
+         p->channels == SENSE_CHANNELS && (p->storageMode == STORE_EDGES || SENSE_CHANNELS == 1) &&
+         p->senseMode <= SENSE_ANALOG && (p->senseMode == SENSE_DIGITAL || SENSE_CHANNELS == 1) &&
+         p->closedThreshold < p->openThreshold && p->openThreshold <= ADC_MAX;
+}
+
+unsigned short paramsChecksum(const sensingParams * p) {
+  const unsigned short * word = (const unsigned short *)p;
+  unsigned short sum = 0;
+  while (word < &p->checksum) {
+    sum += *word++;
+  }
+  return ~sum;
+}
+
+// write params to information memory segment D
+void saveParams(void) {
+  unsigned short * dst = (unsigned short *)&storedParams;
+  const unsigned short * src = (const unsigned short *)&params;
+  unsigned char i;
+
+  params.magic = PARAM_MAGIC;
+  params.checksum = paramsChecksum(&params);
+  FCTL1 = FWKEY | ERASE;                      // Set ERASE bit
+  FCTL3 = FWKEY;                              // Clear LOCK bit (segment D is not affected by LOCKA)
+  *dst = 0;                                   // Dummy write to erase Flash segment
+  FCTL1 = FWKEY | WRT;                        // Set WRT bit (for write operations)
+  for (i = 0; i < sizeof(sensingParams) / 2; i++) {
+    dst[i] = src[i];
+  }
+  FCTL1 = FWKEY;                              // Clear WRT bit
+  FCTL3 = FWKEY | LOCK;                       // Set LOCK bit
+}
+
+/* *** Sensor channels and event filter *** */
+
+// read every channel with one read of each port that has any, channel n in bit n
+unsigned char readChannels(void) {
+  unsigned char channel = 0;
+  unsigned char states = 0;
+
+  if (SENSE_P1_PINS) {
+    states |= collectPins(P1IN, SENSE_P1_PINS, &channel);
+  }
+  if (SENSE_P2_PINS) {
+    states |= collectPins(P2IN, SENSE_P2_PINS, &channel);
+  }
+#if BOARD_HAS_PORT4
+  if (SENSE_P4_PINS) {
+    states |= collectPins(P4IN, SENSE_P4_PINS, &channel);
+  }
+#endif
+  return states;
+}
+
+// threshold one conversion of SENSEIN into the channel 0 bit, readings between
+// the thresholds keep the last state
+unsigned char readAnalog(void) {
+  unsigned short value = convertSensor();
+
+  if (value <= params.closedThreshold) {
+    analogState = MAT_CLOSED;
+  } else if (value >= params.openThreshold) {
+    analogState = MAT_OPEN;
+  } else if (analogState == MAT_UNDEF) {  /* no history yet, take the nearer threshold */
+    analogState = (value - params.closedThreshold < params.openThreshold - value) ? MAT_CLOSED : MAT_OPEN;
+  }
+  return (analogState == MAT_OPEN) ? 1 : 0;
+}
+
+// one ADC10 conversion of SENSEIN against VCC, the ADC is only on for the
+// conversion (16 ADC10OSC cycles of sampling and 13 of conversion, a few us)
+unsigned short convertSensor(void) {
+  unsigned short value;
+
+  ADC10AE0 = SENSEIN;                 /* analog input, the digital buffer is off */
+  ADC10CTL1 = SENSEIN_INCH | ADC10SSEL_0 | ADC10DIV_0;
+  ADC10CTL0 = SREF_0 | ADC10SHT_2 | ADC10ON;
+  ADC10CTL0 |= ENC | ADC10SC;
+  while (ADC10CTL1 & ADC10BUSY);
+  value = ADC10MEM;
+  ADC10CTL0 &= ~ENC;
+  ADC10CTL0 = 0;                      /* ADC10 off */
+  ADC10AE0 = 0;
+  return value;
+}
+
+// move the pins of mask in a port reading to the channel bits from *channel on
+unsigned char collectPins(unsigned char in, unsigned char mask, unsigned char * channel) {
+  unsigned char states = 0;
+  unsigned char pin;
+
+  for (pin = BIT0; pin != 0; pin <<= 1) {
+    if (mask & pin) {
+      if (in & pin) {
+        states |= 1 << *channel;
+      }
+      (*channel)++;
+    }
+  }
+  return states;
+}
+
+// forget the mat states, the next confirmed state of each channel is recorded as an event
+void resetEventFilter(void) {
+  unsigned char channel;
+
+  for (channel = 0; channel < SENSE_CHANNELS; channel++) {
+    channels[channel].prevMatState = MAT_UNDEF;
+    channels[channel].runState = MAT_UNDEF;
+    channels[channel].runLength = 0;
+    channels[channel].confirmedState = MAT_UNDEF;
+    channels[channel].pendingState = MAT_UNDEF;
+  }
+  analogState = MAT_UNDEF;
+}
+
+// pass one sensor sample through the filter in front of recordEvent(): a new state
+// has to be seen on confirmSamples samples in a row (hysteresis), then has to last
+// dwellSamples more samples before it is recorded with the time it was first seen.
+// A change that is undone within its dwell time is dropped together with the
+// change that undid it, so short open/close pairs never reach flash
+void filterSample(unsigned char channel, unsigned char matState) {
+  channelState * ch = &channels[channel];
+
+  if (matState != ch->runState) {
+    ch->runState = matState;
+    ch->runLength = 0;
+    ch->runStart = curTimestamp;
+  }
+  if (ch->runLength != 0xFF) {
+    ch->runLength++;
+  }
+
+  if (ch->runState != ch->confirmedState && ch->runLength >= params.confirmSamples) {
+    ch->confirmedState = ch->runState;
+    if (ch->pendingState != MAT_UNDEF) {
+      summary.filteredEvents++;       /* the pending change did not last */
+    }
+    if (ch->confirmedState == ch->prevMatState) {
+      ch->pendingState = MAT_UNDEF;   /* back to the recorded state */
+      summary.filteredEvents++;
+    } else {
+      ch->pendingState = ch->confirmedState;
+      ch->pendingTime = ch->runStart;
+      ch->pendingAge = 0;
+    }
+  }
+
+  if (ch->pendingState != MAT_UNDEF) {
+    if (ch->pendingAge >= params.dwellSamples) {
+      recordEvent(channel, ch->pendingState, ch->pendingTime);
+      ch->pendingState = MAT_UNDEF;
+    } else {
+      ch->pendingAge++;
+    }
+  }
+}
+
+/* *** Occupancy histogram *** */
+
+// count the sample in its bucket (STORE_OCCUPANCY and STORE_COUNTS), buckets start on whole
+// multiples of their length from the epoch, so one that is split by docking is continued afterwards
+void countOccupancy(void) {
+  unsigned long bucketSeconds = params.bucketHours * 3600UL;
+  unsigned long start;
+
+  if (params.storageMode == STORE_EDGES || curTimestamp == 0) {
+    return;
+  }
+  start = curTimestamp - curTimestamp % bucketSeconds;
+  if (start != bucketStart) {
+    commitBucket();
+    bucketStart = start;
+  }
+  if (params.storageMode == STORE_OCCUPANCY && channels[0].confirmedState == MAT_CLOSED) {
+    bucketOccupied++;
+  }
+}
+
+// store the bucket being counted if it saw any occupancy, preceded by a base record
+// when it is too far from the last one
+void commitBucket(void) {
+  unsigned long bucketSeconds = params.bucketHours * 3600UL;
+  unsigned long offset;
+
+  if (params.storageMode == STORE_COUNTS && bucketStart != 0) {
+    bucketOccupied = readPresses();
+  }
+  if (bucketOccupied != 0) {
+    offset = (bucketStart - baseBucket) / bucketSeconds;
+    if (baseBucket == 0 || bucketStart < baseBucket || offset > BUCKET_OFFSET_MAX) {
+      baseBucket = bucketStart;
+      offset = 0;
+      storeRecord(BASE_RECORD_FLAG | (bucketStart & TIMESTAMP_MASK));
     }
-    FCTL1 = FWKEY;                              // Clear WRT bit
-    FCTL3 = FWKEY | LOCKA | LOCK;               // Set LOCK bit
+    storeRecord((offset << BUCKET_OFFSET_SHIFT) | bucketOccupied);
+  }
+  bucketOccupied = 0;
+}
+
+// power the sensor and let timer B count the rising edges on COUNTIN (mat released)
+// in LPM3 without waking the CPU, STORE_COUNTS only
+void startCounting(void) {
+#if HAS_COUNTS
+  P4REN &= ~COUNTIN;
+  P4SEL |= COUNTIN;                   /* TBCLK */
+  P2OUT |= SENVCC;                    /* stays on while counting */
+  TBCCTL0 = 0;
+  TBCTL = TBSSEL_0 | MC_2 | TBCLR;    /* TBCLK, continuous */
+#endif
+}
+
+void stopCounting(void) {
+#if HAS_COUNTS
+  if (P4SEL & COUNTIN) {
+    TBCTL = 0;
+    P2OUT &= ~SENVCC;
+    P4SEL &= ~COUNTIN;
+    P4REN |= COUNTIN;
+  }
+#endif
+}
+
+// presses counted since the last call, BUCKET_COUNT_MAX if the counter wrapped
+unsigned short readPresses(void) {
+#if HAS_COUNTS
+  unsigned short count;
+
+  if (!(P4SEL & COUNTIN)) {
+    return 0;
+  }
+  do {
+    count = TBR;
+  } while (count != TBR);             /* TBCLK is asynchronous to MCLK */
+  if (TBCTL & TBIFG) {
+    count = BUCKET_COUNT_MAX;
+  }
+  TBCTL = TBSSEL_0 | MC_2 | TBCLR;    /* start again from 0 */
+  return count;
+#else
+  return 0;
+#endif
+}
+
+// record event and timestamp in flash memory (STORE_EDGES), stream it when streaming,
+// and add it to the summary
+void recordEvent(unsigned char channel, unsigned char matState, unsigned long timestamp) {
+  /* 31-bit timestamp with the matState in the high bit, or with several channels
+   * the channel in the next 3 bits and the low 28 bits of the timestamp */
+  unsigned long record = (((unsigned long)matState) << MAT_STATE_SHIFT) | (timestamp & RECORD_TIME_MASK);
+  channelState * ch = &channels[channel];
+
+  if (SENSE_CHANNELS > 1) {
+    record |= ((unsigned long)channel) << CHANNEL_SHIFT;
+  }
+
+  if (mode == STREAMMODE) {           /* push the new record to the PC right away, even if storage is full */
+    sendFrame(FRAME_EVENT, (const unsigned char *)&record, TIMESTAMP_BYTES);
+  }
+  if (params.storageMode == STORE_EDGES) {
+    storeEdge(record);
+  }
+  ch->prevMatState = matState;
 
+  if (summary.events != 0xFFFF) {
+    summary.events++;
+  }
+  if (summary.firstTime == 0) {
+    summary.firstTime = timestamp;
+  }
+  summary.lastTime = timestamp;
+  endClosedRun(ch, timestamp);
+  if (matState == MAT_CLOSED) {
+    ch->closedSince = timestamp;
+  }
+}
+
+// add the MAT_CLOSED time of a channel up to timestamp to the summary
+void endClosedRun(channelState * ch, unsigned long timestamp) {
+  if (ch->closedSince != 0 && timestamp > ch->closedSince) {
+    summary.occupiedSeconds += timestamp - ch->closedSince;
+  }
+  ch->closedSince = 0;
+}
+
+// full timestamp of a record: with several channels only the low 28 bits are
+// stored, which are taken as the latest time up to now that ends in them
+unsigned long recordTime(unsigned long record) {
+  if (SENSE_CHANNELS == 1) {
+    return record & TIMESTAMP_MASK;
+  }
+  return curTimestamp - ((curTimestamp - record) & RECORD_TIME_MASK);
+}
+
+// store a record, the RAM buffer is copied to flash when it is full
+void storeRecord(unsigned long record) {
+  /* timestamp buffer in RAM is full and there is space in the timestamp storage in FLASH */
+  if ((timeBufferIndex == TIMESTAMP_BUFF_SIZE) && storageHasRoom()) {
+    writeBlock(timestampBuffer);
     timeBufferIndex = 0;                /* RAM buffer is now empty */
   }
 
   /* store new timestamp into local RAM buffer */
   if (timeBufferIndex < TIMESTAMP_BUFF_SIZE) {
-    /* store 31-bit timestamp with the matState in the high bit */
-    timestampBuffer[timeBufferIndex++] = (((unsigned long)matState) << MAT_STATE_SHIFT) | (curTimestamp & TIMESTAMP_MASK);
-    prevMatState = matState;
+    timestampBuffer[timeBufferIndex++] = record;
+  } else if (summary.droppedRecords != 0xFFFF) {
+    summary.droppedRecords++;
+  }
+}
+
+// copy a block from RAM to the next block of FLASH storage
+void writeBlock(const unsigned long * block) {
+  unsigned long * timestampStoragePtr = (unsigned long *)timestampStorage;
+  FCTL1 = FWKEY | WRT;                      // Set WRT bit (for write operations)
+  FCTL3 = FWKEY | LOCKA;                    // Clear LOCK bit
+  unsigned char i;
+  for (i = 0; i < TIMESTAMP_BUFF_SIZE; i++) {
+    timestampStoragePtr[timeStorIndex++] = block[i];
   }
+  FCTL1 = FWKEY;                              // Clear WRT bit
+  FCTL3 = FWKEY | LOCKA | LOCK;               // Set LOCK bit
 }
 
 // clear all timestamps, and prepares to record more
 void clearTimestamps(void) {
   timeBufferIndex = 0;
   timeStorIndex = 0;
+  blockMode = BLOCK_UNDECIDED;
+  bitmapCount = BITMAP_IDLE;
+  bitmapBlocks = 0;
+  downloadCount = 0;
+  resetCursor(&readStart);
+  readCursor = readStart;
+  summary.events = 0;
+  summary.firstTime = 0;
+  summary.lastTime = 0;
+  summary.occupiedSeconds = 0;
+  summary.droppedRecords = 0;
+  summary.filteredEvents = 0;
+  {
+    unsigned char channel;
+    for (channel = 0; channel < SENSE_CHANNELS; channel++) {
+      channels[channel].closedSince = 0;
+    }
+  }
+  bucketStart = 0;
+  bucketOccupied = 0;
+  baseBucket = 0;
 
   /* erase timestamp storage (in FLASH) */
   unsigned long * timestampStoragePtr = (unsigned long *)timestampStorage;
@@ -464,13 +1559,250 @@ void clearTimestamps(void) {
   FCTL3 = FWKEY | LOCKA | LOCK;               // Set LOCK bit
 }
 
-// retrieve timestamp from flash memory
+// returns the total number of stored records, counting a bitmap block as its edges
+unsigned short getNumTimestamps(void) {
+  logCursor c;
+  unsigned long record;
+
+  resetCursor(&c);
+  while (nextRecord(&c, &record));
+  return c.index;
+}
+
+// retrieve a record of the 'd' or 'f' walk from flash memory or the RAM buffer, going
+// on from the last one so that a download decodes each block only once
 unsigned long getTimestamp(unsigned short timestampIndex) {
-  if (timestampIndex < timeStorIndex) {   /* pull value from FLASH storage */
-    return timestampStorage[timestampIndex];
-  } else if ((timestampIndex - timeStorIndex) < timeBufferIndex) { /* pull from RAM buffer */
-    return timestampBuffer[timestampIndex - timeStorIndex];
-  } else {    /* index out of range */
+  unsigned long record = 0;
+
+  if (timestampIndex < readCursor.index) {
+    readCursor = readStart;
+  }
+  while (readCursor.index <= timestampIndex) {
+    if (!nextRecord(&readCursor, &record)) {
+      return 0;   /* index out of range */
+    }
+  }
+  return record;
+}
+
+// start the walk with 'e' at the first record from first to last (timestamps,
+// inclusive) and return the number of records in the range (STORE_EDGES only).
+// Records are stored in time order, so the flash blocks are binary searched by the
+// time of their first record and decoding starts in the last block that starts
+// before first. Records at first can end the block before one that starts at first
+unsigned short findRange(unsigned long first, unsigned long last) {
+  unsigned char lo = 0;
+  unsigned char hi = timeStorIndex / TIMESTAMP_BUFF_SIZE;
+  unsigned short count = 0;
+  unsigned long record;
+  logCursor c;
+
+  if (params.storageMode != STORE_EDGES) {
     return 0;
   }
+  while (hi - lo > 1) {       /* lo: last block known to start before first, or 0 when none does */
+    unsigned char mid = (lo + hi) / 2;
+    if (recordTime(timestampStorage[mid * TIMESTAMP_BUFF_SIZE]) < first) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  seekBlock(&c, lo);
+  readStart = c;
+  while (nextRecord(&c, &record) && recordTime(record) <= last) {
+    if (recordTime(record) < first) {
+      readStart = c;                  /* the range starts after this record */
+    } else {
+      count++;
+    }
+  }
+  readStart.index = 0;
+  readCursor = readStart;
+  return count;
+}
+
+/* *** Adaptive block encoding *** */
+
+// store an edge record in the block being filled. An undecided block fills both
+// encodings from its first edge: a ninth edge before the bitmap is full makes it a
+// bitmap block, a full bitmap first makes it an edge block
+void storeEdge(unsigned long record) {
+  unsigned long timestamp = record & TIMESTAMP_MASK;
+  unsigned char matState = (unsigned char)(record >> MAT_STATE_SHIFT);
+
+  if (SENSE_CHANNELS > 1) {
+    storeRecord(record);              /* a bitmap holds one channel */
+    return;
+  }
+
+  if (timeBufferIndex == TIMESTAMP_BUFF_SIZE && storageHasRoom()) {
+    if (blockMode == BLOCK_UNDECIDED) {
+      blockMode = BLOCK_BITMAP;       /* the bitmap holds these edges in fewer words */
+      timeBufferIndex = 0;
+    } else if (blockMode == BLOCK_EDGES) {
+      blockMode = BLOCK_UNDECIDED;    /* storeRecord() writes the block, this edge starts the next one */
+    }
+  }
+  if (blockMode == BLOCK_UNDECIDED && bitmapCount == BITMAP_IDLE) {
+    startBitmap(timestamp);
+  }
+  if (blockMode != BLOCK_BITMAP) {
+    storeRecord(record);
+  }
+  setBitmapState(timestamp, matState);
+}
+
+// start the bitmap at the sample of the block's first edge, which the dwell time
+// may put a few samples back
+void startBitmap(unsigned long timestamp) {
+  unsigned long samples = (curTimestamp - timestamp) / params.senseSeconds;
+  unsigned char i;
+
+  if (samples >= BITMAP_SAMPLES) {
+    blockMode = BLOCK_EDGES;          /* an edge that old already beats the bitmap */
+    return;
+  }
+  bitmapBuffer[0] = timestamp;
+  bitmapBuffer[1] = (unsigned long)params.senseSeconds << BITMAP_SECONDS_SHIFT;
+  for (i = BITMAP_HEADER_WORDS; i < TIMESTAMP_BUFF_SIZE; i++) {
+    bitmapBuffer[i] = 0;
+  }
+  bitmapCount = (unsigned char)samples;
+}
+
+// set the samples of the bitmap from timestamp on to the recorded mat state
+void setBitmapState(unsigned long timestamp, unsigned char matState) {
+  unsigned long first;
+  unsigned char i;
+
+  if (bitmapCount == BITMAP_IDLE) {
+    return;
+  }
+  first = (timestamp > bitmapBuffer[0]) ? (timestamp - bitmapBuffer[0]) / params.senseSeconds : 0;
+  for (i = (first < bitmapCount) ? (unsigned char)first : bitmapCount; i < bitmapCount; i++) {
+    if (matState == MAT_OPEN) {
+      bitmapBuffer[BITMAP_HEADER_WORDS + (i >> 5)] |= 1UL << (i & 31);
+    } else {
+      bitmapBuffer[BITMAP_HEADER_WORDS + (i >> 5)] &= ~(1UL << (i & 31));
+    }
+  }
+}
+
+// add the current sample to the bitmap, which is written to flash when it is
+// full in a bitmap block and dropped in an undecided one
+void sampleBitmap(void) {
+  if (params.storageMode != STORE_EDGES || bitmapCount == BITMAP_IDLE) {
+    return;
+  }
+  bitmapCount++;
+  setBitmapState(curTimestamp, channels[0].prevMatState);
+  if (bitmapCount == BITMAP_SAMPLES) {
+    if (blockMode == BLOCK_BITMAP) {
+      writeBitmap();
+      blockMode = BLOCK_UNDECIDED;
+    } else {
+      blockMode = BLOCK_EDGES;        /* no more than eight edges in its time, edge records are denser */
+    }
+    bitmapCount = BITMAP_IDLE;
+  }
+}
+
+// write the bitmap to flash as the next block, its edges are dropped if the storage is full
+void writeBitmap(void) {
+  if (!storageHasRoom()) {
+    logCursor c;
+    unsigned long record;
+    seekBlock(&c, timeStorIndex / TIMESTAMP_BUFF_SIZE);
+    while (nextRecord(&c, &record));  /* c.index: edges in the bitmap */
+    summary.droppedRecords = (c.index < 0xFFFF - summary.droppedRecords) ? summary.droppedRecords + c.index : 0xFFFF;
+    return;
+  }
+  bitmapBuffer[1] |= bitmapCount;
+  bitmapBlocks |= 1U << (timeStorIndex / TIMESTAMP_BUFF_SIZE);
+  writeBlock(bitmapBuffer);
+}
+
+// end the block being filled when docking, the samples of a bitmap have to be contiguous
+void closeBlock(void) {
+  if (blockMode == BLOCK_BITMAP) {
+    writeBitmap();                    /* partly filled, its edges count as dropped if the storage is full */
+  }
+  /* edges from before docking stay edges, a bitmap of the samples after it would lose them */
+  blockMode = (timeBufferIndex != 0) ? BLOCK_EDGES : BLOCK_UNDECIDED;
+  bitmapCount = BITMAP_IDLE;
+}
+
+// go back to the first record
+void resetCursor(logCursor * c) {
+  c->index = 0;
+  c->block = 0;
+  c->pos = 0;
+  c->matState = MAT_UNDEF;
+}
+
+// go to the start of a flash block, with the mat state the block before it ended in
+void seekBlock(logCursor * c, unsigned char block) {
+  const unsigned long * words;
+  unsigned char i;
+
+  resetCursor(c);
+  if (block == 0) {
+    return;
+  }
+  words = &timestampStorage[(block - 1) * TIMESTAMP_BUFF_SIZE];
+  if ((bitmapBlocks >> (block - 1)) & 1) {
+    i = (unsigned char)words[1] - 1;  /* last sample */
+    c->matState = (unsigned char)(words[BITMAP_HEADER_WORDS + (i >> 5)] >> (i & 31)) & 1;
+  } else {
+    c->matState = (unsigned char)(words[TIMESTAMP_BUFF_SIZE - 1] >> MAT_STATE_SHIFT);
+  }
+  c->block = block;
+}
+
+// step to the next record, flash blocks first and the RAM buffer last, returns false
+// at the end of the log
+bool nextRecord(logCursor * c, unsigned long * record) {
+  unsigned char flashBlocks = timeStorIndex / TIMESTAMP_BUFF_SIZE;
+  const unsigned long * words;
+  unsigned char len;
+  bool bitmap;
+
+  while (c->block <= flashBlocks) {
+    if (c->block < flashBlocks) {
+      words = &timestampStorage[c->block * TIMESTAMP_BUFF_SIZE];
+      bitmap = (bitmapBlocks >> c->block) & 1;
+      len = bitmap ? (unsigned char)words[1] : TIMESTAMP_BUFF_SIZE;
+    } else if (blockMode == BLOCK_BITMAP) {
+      words = bitmapBuffer;
+      bitmap = true;
+      len = bitmapCount;
+    } else {
+      words = timestampBuffer;
+      bitmap = false;
+      len = timeBufferIndex;
+    }
+
+    if (bitmap) {                     /* a record for each sample that differs from the one before */
+      while (c->pos < len) {
+        unsigned char i = c->pos++;
+        unsigned char matState = (unsigned char)(words[BITMAP_HEADER_WORDS + (i >> 5)] >> (i & 31)) & 1;
+        if (matState != c->matState) {
+          unsigned long seconds = (unsigned char)(words[1] >> BITMAP_SECONDS_SHIFT);
+          c->matState = matState;
+          c->index++;
+          *record = (((unsigned long)matState) << MAT_STATE_SHIFT) | ((words[0] + i * seconds) & RECORD_TIME_MASK);
+          return true;
+        }
+      }
+    } else if (c->pos < len) {
+      *record = words[c->pos++];
+      c->matState = (unsigned char)(*record >> MAT_STATE_SHIFT);
+      c->index++;
+      return true;
+    }
+    c->block++;
+    c->pos = 0;
+  }
+  return false;
 }
\ No newline at end of file
@@ -0,0 +1,99 @@
+/*
+    pins.h
+    Compile-time pin map for the MSP430F2xx ports
+
+    A program describes each port once with PORT_MAP, giving the pins of
+    every role as a bit mask:
+
+      #define P1_MAP  PORT_MAP(DBG0, 0, 0, 0, 0, SMCLKO)
+
+    and sets the port up with PORT_SETUP(1, P1_MAP). The masks are folded
+    into one constant per register, so the setup is a single write each to
+    PxDIR, PxOUT, PxREN and PxSEL, the same code as writing the values by
+    hand. Pins with no role are inputs with the pull-down on, so nothing
+    floats.
+
+    PORT_CONFLICT is true when a pin has more than one role, for example a
+    pull resistor left on an output. The maps are checked with it when this
+    header is included a second time, after them:
+
+      #include "pins.h"
+      #define P1_MAP  PORT_MAP(DBG0, 0, 0, 0, 0, SMCLKO)
+      #define P2_MAP  PORT_MAP(0, 0, PCCOMM, 0, XIN | XOUT, 0)
+      #include "pins.h"             checks P1_MAP .. P4_MAP, those defined
+
+    so the masks must be plain constants the preprocessor can evaluate.
+
+    A map expands to its six masks separated by commas, so it is only passed
+    by name straight to the PORT_ macros, never through another macro.
+*/
+
+#ifndef PINS_H
+#define PINS_H
+
+/* pin roles of a port, in this order:
+ *  outLow      output, starts low
+ *  outHigh     output, starts high
+ *  in          input driven from outside, no pull resistor
+ *  pullUp      input with the pull-up on
+ *  periph      peripheral function, direction set by the module or input (UART, XIN/XOUT)
+ *  periphOut   peripheral function that needs the pin as output (clock outputs, timer outputs) */
+#define PORT_MAP(outLow, outHigh, in, pullUp, periph, periphOut) \
+        (outLow), (outHigh), (in), (pullUp), (periph), (periphOut)
+
+/* register values of a map, expanded in two steps so the map becomes the argument list */
+#define PORT_DIR(map)           PORT_DIR_(map)
+#define PORT_OUT(map)           PORT_OUT_(map)
+#define PORT_REN(map)           PORT_REN_(map)
+#define PORT_SEL(map)           PORT_SEL_(map)
+#define PORT_CONFLICT(map)      PORT_CONFLICT_(map)
+
+#define PORT_DIR_(outLow, outHigh, in, pullUp, periph, periphOut) \
+        ((outLow) | (outHigh) | (periphOut))
+#define PORT_OUT_(outLow, outHigh, in, pullUp, periph, periphOut) \
+        ((outHigh) | (pullUp))
+#define PORT_REN_(outLow, outHigh, in, pullUp, periph, periphOut) \
+        (0xFF & ~((outLow) | (outHigh) | (in) | (periph) | (periphOut)))
+#define PORT_SEL_(outLow, outHigh, in, pullUp, periph, periphOut) \
+        ((periph) | (periphOut))
+#define PORT_CONFLICT_(outLow, outHigh, in, pullUp, periph, periphOut) \
+        (((outLow) & ((outHigh) | (in) | (pullUp) | (periph) | (periphOut))) || \
+         ((outHigh) & ((in) | (pullUp) | (periph) | (periphOut))) || \
+         ((in) & ((pullUp) | (periph) | (periphOut))) || \
+         ((pullUp) & ((periph) | (periphOut))) || \
+         ((periph) & (periphOut)) || \
+         (((outLow) | (outHigh) | (in) | (pullUp) | (periph) | (periphOut)) & ~0xFF))
+
+/* set up port n from its map, OUT before DIR so outputs never glitch high */
+#define PORT_SETUP(n, map)      PORT_SETUP_(n, map)
+#define PORT_SETUP_(n, outLow, outHigh, in, pullUp, periph, periphOut) do { \
+          P##n##OUT = PORT_OUT_(outLow, outHigh, in, pullUp, periph, periphOut); \
+          P##n##DIR = PORT_DIR_(outLow, outHigh, in, pullUp, periph, periphOut); \
+          P##n##REN = PORT_REN_(outLow, outHigh, in, pullUp, periph, periphOut); \
+          P##n##SEL = PORT_SEL_(outLow, outHigh, in, pullUp, periph, periphOut); \
+        } while (0)
+
+#else   /* included again after the maps */
+
+#ifdef P1_MAP
+#if PORT_CONFLICT(P1_MAP)
+#error "P1_MAP: a pin has more than one role"
+#endif
+#endif
+#ifdef P2_MAP
+#if PORT_CONFLICT(P2_MAP)
+#error "P2_MAP: a pin has more than one role"
+#endif
+#endif
+#ifdef P3_MAP
+#if PORT_CONFLICT(P3_MAP)
+#error "P3_MAP: a pin has more than one role"
+#endif
+#endif
+#ifdef P4_MAP
+#if PORT_CONFLICT(P4_MAP)
+#error "P4_MAP: a pin has more than one role"
+#endif
+#endif
+
+#endif
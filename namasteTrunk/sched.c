@@ -0,0 +1,227 @@
+/*
+    sched.c
+    Tickless scheduler on timer A, or on the WDT+ interval (SCHED_WDT)
+
+    All functions expect interrupts to be disabled, as they are in the ISRs
+    and around the mode changes in the main loop.
+
+    The hardware is reached through schedHw.h, which a host build replaces
+    (host/schedTest.c).
+*/
+
+#include "schedHw.h"
+#include "boards.h"
+#include "sched.h"
+
+static unsigned long deadlines[SCHED_TIMERS];
+static schedHandler handlers[SCHED_TIMERS];         /* 0 while the timer is off */
+
+#if SCHED_WDT
+
+#if SCHED_WDT_XT1_DIV % ACLK_DIV != 0 || SCHED_WDT_VLO_DIV % ACLK_DIV != 0
+#error "the WDT+ intervals must be whole ticks of ACLK/ACLK_DIV"
+#endif
+
+static unsigned long schedTicks;                    /* ticks of ACLK/ACLK_DIV since schedStart(), at the last WDT+ interrupt */
+static unsigned short schedStep;                    /* ticks in one WDT+ interval */
+
+// start the longest WDT+ interval for the ACLK source in BCSCTL3, the WDT_ADLY_
+// names give the time at 32768 Hz
+static void schedWdtInterval(void) {
+  if (BCSCTL3 & LFXT1S_2) {
+    schedStep = SCHED_WDT_VLO_DIV / ACLK_DIV;
+    WDTCTL = WDT_ADLY_250;
+  } else {
+    schedStep = SCHED_WDT_XT1_DIV / ACLK_DIV;
+    WDTCTL = WDT_ADLY_1000;
+  }
+}
+
+// start counting from 0 with every timer off, does nothing if the WDT+ already runs
+void schedStart(void) {
+  unsigned char timer;
+  if (schedRunning()) {
+    return;
+  }
+  for (timer = 0; timer < SCHED_TIMERS; timer++) {
+    schedCancel(timer);
+  }
+  schedTicks = 0;
+  schedWdtInterval();
+  IFG1 &= ~WDTIFG;
+  IE1 |= WDTIE;
+}
+
+// hold the WDT+ and drop every timer, for LPM4 when there is no time to keep
+void schedStop(void) {
+  unsigned char timer;
+  WDTCTL = WDTPW | WDTHOLD;
+  IE1 &= ~WDTIE;
+  IFG1 &= ~WDTIFG;
+  for (timer = 0; timer < SCHED_TIMERS; timer++) {
+    schedCancel(timer);
+  }
+}
+
+// ACLK moved to another oscillator: restart the interval that matches it, losing
+// at most the part of an interval counted so far
+void schedClockChanged(void) {
+  if (schedRunning()) {
+    schedWdtInterval();
+  }
+}
+
+bool schedRunning(void) {
+  return (WDTCTL & WDTHOLD) == 0;
+}
+
+// ticks since schedStart(), counting an interval whose interrupt is still pending
+unsigned long schedNow(void) {
+  return schedTicks + ((IFG1 & WDTIFG) ? schedStep : 0);
+}
+
+// call handler from the WDT+ ISR once schedNow() reaches deadline, replacing what
+// the timer was set to before
+void schedAt(unsigned char timer, unsigned long deadline, schedHandler handler) {
+  deadlines[timer] = deadline;
+  handlers[timer] = handler;
+}
+
+void schedCancel(unsigned char timer) {
+  handlers[timer] = 0;
+}
+
+#else
+
+static volatile unsigned short * const schedCcr[SCHED_TIMERS] = { &CCR0, &CCR1, &CCR2 };
+static volatile unsigned short * const schedCctl[SCHED_TIMERS] = { &CCTL0, &CCTL1, &CCTL2 };
+
+static unsigned short schedHigh;                    /* timer A wraps since schedStart() */
+
+// start counting from 0 with every timer off, does nothing if timer A already runs
+void schedStart(void) {
+  unsigned char timer;
+  if (schedRunning()) {
+    return;
+  }
+  for (timer = 0; timer < SCHED_TIMERS; timer++) {
+    schedCancel(timer);
+  }
+  schedHigh = 0;
+  TACTL = TASSEL_1 | ACLK_ID | MC_2 | TACLR | TAIE;  /* ACLK/ACLK_DIV, continuous, count the wraps */
+}
+
+// stop timer A and every timer, for LPM4 when there is no time to keep
+void schedStop(void) {
+  unsigned char timer;
+  TACTL = 0;
+  for (timer = 0; timer < SCHED_TIMERS; timer++) {
+    schedCancel(timer);
+  }
+}
+
+// timer A counts ACLK/ACLK_DIV whatever the oscillator, the caller converts the ticks
+void schedClockChanged(void) {
+}
+
+bool schedRunning(void) {
+  return (TACTL & MC_2) != 0;
+}
+
+// ticks since schedStart(). TAR is clocked from ACLK asynchronously to MCLK, so it
+// is read until two reads agree, and a wrap whose interrupt is still pending is
+// counted here
+unsigned long schedNow(void) {
+  unsigned short high = schedHigh;
+  unsigned short ticks;
+  do {
+    ticks = TAR;
+  } while (ticks != TAR);
+  if (TACTL & TAIFG) {
+    do {
+      ticks = TAR;                        /* certainly after the wrap now */
+    } while (ticks != TAR);
+    high++;
+  }
+  return ((unsigned long)high << 16) | ticks;
+}
+
+// call handler from the timer ISR once schedNow() reaches deadline, replacing what
+// the timer was set to before
+void schedAt(unsigned char timer, unsigned long deadline, schedHandler handler) {
+  deadlines[timer] = deadline;
+  handlers[timer] = handler;
+  *schedCcr[timer] = (unsigned short)deadline;
+  *schedCctl[timer] = CCIE;
+  if ((long)(deadline - schedNow()) <= 0) {
+    *schedCctl[timer] = CCIE | CCIFG;     /* already due, the compare would only match after a wrap */
+  }
+}
+
+void schedCancel(unsigned char timer) {
+  *schedCctl[timer] = 0;
+  handlers[timer] = 0;
+}
+
+#endif
+
+// deadline the timer was last set to, the base for the next one of a periodic timer
+unsigned long schedDeadline(unsigned char timer) {
+  return deadlines[timer];
+}
+
+// compare match of a timer, or any WDT+ tick: run its handler if the deadline has
+// really passed and not just its low 16 bits, returns the handler's wish to leave
+// the low power mode
+bool schedFire(unsigned char timer) {
+  schedHandler handler = handlers[timer];
+  if (!handler || (long)(deadlines[timer] - schedNow()) > 0) {
+    return false;                         /* stays armed for the match after the next wrap */
+  }
+  schedCancel(timer);                     /* the handler sets the next deadline, if any */
+  return handler();
+}
+
+#if SCHED_WDT
+
+SCHED_ISR(WDT_VECTOR, schedWdtIsr) {
+  bool wake = false;
+  unsigned char timer;
+  schedTicks += schedStep;
+  for (timer = 0; timer < SCHED_TIMERS; timer++) {
+    if (schedFire(timer)) {
+      wake = true;
+    }
+  }
+  if (wake) {
+    SCHED_WAKE();
+  }
+}
+
+#else
+
+SCHED_ISR(TIMERA0_VECTOR, schedCcr0Isr) {
+  if (schedFire(0)) {
+    SCHED_WAKE();
+  }
+}
+
+SCHED_ISR(TIMERA1_VECTOR, schedTimerAIsr) {
+  bool wake = false;
+  switch (TAIV) {                         /* reading TAIV clears the flag it reports */
+  case TAIV_TACCR1:
+    wake = schedFire(1);
+    break;
+  case TAIV_TACCR2:
+    wake = schedFire(2);
+    break;
+  case TAIV_TAIFG:
+    schedHigh++;
+    break;
+  }
+  if (wake) {
+    SCHED_WAKE();
+  }
+}
+
+#endif
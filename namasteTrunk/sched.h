@@ -0,0 +1,53 @@
+/*
+    sched.h
+    Tickless scheduler on timer A
+
+    Timer A runs from ACLK/ACLK_DIV (boards.h) in continuous mode and is
+    never stopped or cleared while there is time to keep, so schedNow()
+    counts ticks across every mode change. Each subsystem owns one scheduler
+    timer and registers an absolute deadline in those ticks. A timer is one compare channel
+    (timer 0 is CCR0, 1 is CCR1, 2 is CCR2), so overlapping deadlines each
+    get their own channel, and the CPU sleeps until the nearest one.
+
+    Deadlines further away than the 16-bit timer simply let the channel
+    match again after the next wrap. A deadline that has already passed
+    fires at once.
+
+    The registers are reached through schedHw.h, so sched.c also builds on a
+    host against plain variables in place of them (host/schedTest.c).
+
+    With SCHED_WDT the time base is the watchdog in interval mode instead,
+    and timer A is left alone. The WDT+ uses its longest interval for the
+    oscillator, SCHED_WDT_XT1_DIV periods of the crystal (1 s) or
+    SCHED_WDT_VLO_DIV periods of the VLO (0.75 s), and each interrupt adds
+    the ACLK/ACLK_DIV ticks of its interval, so schedNow() counts the same
+    ticks as with timer A and the caller's fractional ticks per second stay
+    in its sub-second phase. The CPU wakes once per interval and compares
+    the deadlines in software, so a deadline fires at the first interrupt
+    at or after it.
+*/
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdbool.h>
+
+#define SCHED_WDT       0       /* 1: count WDT+ intervals instead of running timer A */
+#define SCHED_TIMERS    3       /* compare channels of timer A, or software deadlines with SCHED_WDT */
+#define SCHED_WDT_XT1_DIV   32768   /* ACLK periods in a WDT+ interval on the crystal, WDT_ADLY_1000 */
+#define SCHED_WDT_VLO_DIV   8192    /* ACLK periods in a WDT+ interval on the VLO, WDT_ADLY_250 */
+
+/* runs in the timer ISR once its deadline has passed, returns true to leave the low power mode */
+typedef bool (*schedHandler)(void);
+
+void schedStart(void);
+void schedStop(void);
+void schedClockChanged(void);
+bool schedRunning(void);
+unsigned long schedNow(void);
+void schedAt(unsigned char timer, unsigned long deadline, schedHandler handler);
+void schedCancel(unsigned char timer);
+unsigned long schedDeadline(unsigned char timer);
+bool schedFire(unsigned char timer);
+
+#endif
@@ -0,0 +1,36 @@
+/*
+    schedHw.h
+    Hardware used by sched.c
+
+    sched.c reaches the timer A and WDT+ registers, the interrupt vectors and
+    the low power mode only through this header. A host build replaces it:
+    the program defines SCHED_HW_H, declares plain variables by the register
+    names and defines the two macros below, then includes sched.c, as
+    host/schedTest.c does.
+*/
+
+#ifndef SCHED_HW_H
+#define SCHED_HW_H
+
+#include <msp430.h>
+
+/* chips with a second timer A, such as the MSP430F2132, name the first one Timer0_A3 */
+#ifndef TIMERA0_VECTOR
+#define TIMERA0_VECTOR              TIMER0_A0_VECTOR
+#define TIMERA1_VECTOR              TIMER0_A1_VECTOR
+#endif
+#ifndef TAIV_TAIFG
+#define TAIV_TACCR1                 TA0IV_TACCR1
+#define TAIV_TACCR2                 TA0IV_TACCR2
+#define TAIV_TAIFG                  TA0IV_TAIFG
+#endif
+
+/* interrupt handler for vector, the vector number is expanded before the pragma is made */
+#define SCHED_ISR(vec, name)        SCHED_VECTOR_(vec) __interrupt void name(void)
+#define SCHED_VECTOR_(vec)          SCHED_PRAGMA_(vector=vec)
+#define SCHED_PRAGMA_(text)         _Pragma(#text)
+
+/* leave the low power mode when the ISR returns */
+#define SCHED_WAKE()                __low_power_mode_off_on_exit()
+
+#endif